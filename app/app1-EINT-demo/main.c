@@ -1,4 +1,6 @@
 #include "uart.h"
+#include "pmu.h"
+#include "vic.h"
 
 #define GPH2CON		(*(volatile unsigned int *)0xE0200C40)
 #define GPH2DAT		(*(volatile unsigned int *)0xE0200C44)
@@ -8,17 +10,6 @@
 #define EXT_INT_2_CON		(*(volatile unsigned int *)0xE0200E08)
 #define EXT_INT_2_MASK		(*(volatile unsigned int *)0xE0200F08)
 
-// VIC
-#define VIC0RAWINTR			(*(volatile unsigned int *)0xF2000008)
-#define VIC0IRQSTATUS		(*(volatile unsigned int *)0xF2000000)
-#define VIC0FIQSTATUS		(*(volatile unsigned int *)0xF2000004)
-#define VIC0INTENABLE		(*(volatile unsigned int *)0xF2000010)
-#define VIC0INTSELECT		(*(volatile unsigned int *)0xF200000C)
-#define VIC0VECTADDR16		(*(volatile unsigned int *)0xF2000140)
-  
-#define VIC0ADDRESS		(*(volatile unsigned int *)0xF2000F00)
-  
-
 void delay(void)
 {
 	int i;
@@ -27,24 +18,21 @@ void delay(void)
 		;
 }
 
-void C_IRQ_handler(void)
+// INT_EINT16, the key on GPH2_0
+static void eint16_irq(void * ctx)
 {
 	// clear pending bit
 	EXT_INT_2_PEND = 1;			
 	
-	// clear VectAddr
-	VIC0ADDRESS = 0;
-	
 	uart_putchar(' ');
 	uart_putchar('+');
 	uart_putchar(' ');	
 }		
 
-extern void asm_IRQ_handler(void);
-
 int mymain(void)
 {
 	uart_init();
+	pmu_init();
 
 	// set GPH2_0 as input
 	//GPH2CON = 0x0;
@@ -59,30 +47,14 @@ int mymain(void)
 	// 3. Set EXT_INT_2_MASK open
 	EXT_INT_2_MASK &= ~(1<<0);
 	
-	// init VIC (Vectored Interrupt Controller)
-	// 1. Set Enable bit (MASK)
-	VIC0INTENABLE |= 1<<16;
-	
-	// 2. Set Mode bit (IRQ/FIQ)
-	VIC0INTSELECT &= ~(1<<16);
+	// init VIC (Vectored Interrupt Controller): every vector to
+	// asm_IRQ_handler, then enable, IRQ mode and handler in one go
+	irq_init();
+	irq_register(INT_EINT16, eint16_irq, 0, 0);
 	
 	// init CPSR I-bit (open IRQ disable bit)	0xD3->0x53
 	// see it in start.s
 	
-	// open VIC port 
-	// in Cortex A8 core, It seems VIC is open as default 
-	
-#define VIC	
-//#undef VIC
-#ifdef VIC
-	// install IRQ handler to Vectors
-	//VIC0VECTADDR16 = (int)C_IRQ_handler;		// C_IRQ_handler is not RIGHT
-	VIC0VECTADDR16 = (int)asm_IRQ_handler;
-#else
-	// set all exception vectors addresses from 0xD0037400
-	*(int *)(0xD0037400 + 0x18) = (int)asm_IRQ_handler;	
-#endif
-	
 	while (1)
 	{	
 		char c;
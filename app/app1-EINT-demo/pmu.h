@@ -0,0 +1,25 @@
+
+// Cortex-A8 PMU cycle counter (CCNT), counts ARMCLK cycles (1GHz, set up by the bootloader clock.c)
+
+static inline void pmu_init(void)
+{
+	unsigned int v;
+
+	// PMCR: [0] E = enable counters, [2] C = reset CCNT, [3] D = 0 count every cycle
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c12, 0" : "=r" (v));
+	v |= (1<<0) | (1<<2);
+	v &= ~(1<<3);
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 0" : : "r" (v));
+
+	// PMCNTENSET: [31] enable CCNT
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" : : "r" (1<<31));
+}
+
+static inline unsigned int pmu_get_cycles(void)
+{
+	unsigned int v;
+
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r" (v));
+
+	return v;
+}
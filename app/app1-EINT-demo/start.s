@@ -4,6 +4,11 @@
 _start:
 	ldr sp, =0xD0028000	
 
+	@ IRQ mode stack, once: asm_IRQ_handler keeps 2 words a level on it
+	msr cpsr_c, #0xD2
+	ldr sp, =0xD0034000
+	msr cpsr_c, #0xD3
+
 	mov r0, #0x53
 	msr	CPSR_cxsf, r0
 
@@ -11,15 +16,26 @@ _start:
 	@ldr pc, =mymain
 	
 
+@ IRQ entry of every VIC vector (see vic.c), the handlers run in SVC mode
+@ on the interrupted stack, so with irq_nesting they can be interrupted
+@ without losing lr_irq.
 .global asm_IRQ_handler
 asm_IRQ_handler:
-	@ set sp_irq = iRAM top (sp--)
-	ldr sp, =0xD0034000
-	
 	@ lr = lr - 4
 	sub r14, r14, #4
-	STMFD r13!, {r1-r12, r14}
-	
+	stmfd r13!, {r14}
+	mrs r14, spsr
+	stmfd r13!, {r14}
+
+	@ SVC, irqs still off: the caller-saved registers of whoever was interrupted
+	msr cpsr_c, #0xD3
+	stmfd r13!, {r0-r3, r12, r14}
+
 	bl C_IRQ_handler
-	
-	LDMFD r13!, {r1-r12, pc}^
+
+	ldmfd r13!, {r0-r3, r12, r14}
+	msr cpsr_c, #0xD2
+
+	ldmfd r13!, {r14}
+	msr spsr_cxsf, r14
+	ldmfd r13!, {pc}^
@@ -0,0 +1,203 @@
+
+#include "pmu.h"
+#include "vic.h"
+
+#define VIC_BASE(v)		(0xF2000000 + (v) * 0x100000)
+#define VIC_IRQSTATUS(v)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x000))
+#define VIC_INTSELECT(v)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x00C))
+#define VIC_INTENABLE(v)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x010))	// write 1 to enable
+#define VIC_INTENCLEAR(v)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x014))	// write 1 to disable
+#define VIC_SOFTINTCLEAR(v)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x01C))
+#define VIC_VECTADDR(v, b)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x100 + (b) * 4))
+#define VIC_VECTPRIORITY(v, b)	(*(volatile unsigned int *)(VIC_BASE(v) + 0x200 + (b) * 4))
+#define VIC_ADDRESS(v)		(*(volatile unsigned int *)(VIC_BASE(v) + 0xF00))
+
+extern void asm_IRQ_handler(void);
+
+struct irq_desc {
+	irq_handler_t handler;
+	void * ctx;
+	int prio;
+};
+
+static struct irq_desc irq_descs[IRQ_NR];
+static struct irq_stat irq_stats[IRQ_NR];
+
+// the sources of each priority, per VIC
+static unsigned int irq_prio_mask[IRQ_PRIOS][4];
+
+// on by irq_enable() and not off by irq_disable() since, per VIC: all that
+// _dispatch() may turn back on after a nested handler
+static unsigned int irq_enabled[4];
+
+int irq_nesting;
+
+void irq_init(void)
+{
+	int v, b;
+
+	for (v = 0; v < 4; v++) {
+		VIC_INTENCLEAR(v) = 0xffffffff;
+		VIC_SOFTINTCLEAR(v) = 0xffffffff;
+		VIC_INTSELECT(v) = 0;			// all IRQ, no FIQ
+		for (b = 0; b < 32; b++) {
+			VIC_VECTADDR(v, b) = (int)asm_IRQ_handler;
+			VIC_VECTPRIORITY(v, b) = IRQ_PRIOS - 1;
+		}
+		VIC_ADDRESS(v) = 0;
+		irq_enabled[v] = 0;
+	}
+
+	for (b = 0; b < IRQ_NR; b++)
+		irq_descs[b].handler = 0;
+	for (b = 0; b < IRQ_PRIOS; b++)
+		for (v = 0; v < 4; v++)
+			irq_prio_mask[b][v] = 0;
+	irq_clear_stats();
+}
+
+int irq_register(int n, irq_handler_t handler, void * ctx, int prio)
+{
+	unsigned int flags;
+
+	if (n < 0 || n >= IRQ_NR || prio < 0 || prio >= IRQ_PRIOS || irq_descs[n].handler)
+		return -1;
+
+	flags = irq_save();
+	irq_descs[n].handler = handler;
+	irq_descs[n].ctx = ctx;
+	irq_descs[n].prio = prio;
+	irq_prio_mask[prio][n / 32] |= 1 << (n % 32);
+	VIC_VECTPRIORITY(n / 32, n % 32) = prio;
+	irq_restore(flags);
+
+	irq_enable(n);
+
+	return 0;
+}
+
+void irq_unregister(int n)
+{
+	unsigned int flags;
+
+	if (n < 0 || n >= IRQ_NR || !irq_descs[n].handler)
+		return;
+
+	irq_disable(n);
+
+	flags = irq_save();
+	irq_prio_mask[irq_descs[n].prio][n / 32] &= ~(1 << (n % 32));
+	irq_descs[n].handler = 0;
+	irq_restore(flags);
+}
+
+void irq_enable(int n)
+{
+	unsigned int flags = irq_save();
+
+	irq_enabled[n / 32] |= 1 << (n % 32);
+	VIC_INTENABLE(n / 32) = 1 << (n % 32);
+	irq_restore(flags);
+}
+
+void irq_disable(int n)
+{
+	unsigned int flags = irq_save();
+
+	irq_enabled[n / 32] &= ~(1 << (n % 32));
+	VIC_INTENCLEAR(n / 32) = 1 << (n % 32);
+	irq_restore(flags);
+}
+
+const struct irq_stat * irq_get_stat(int n)
+{
+	return &irq_stats[n];
+}
+
+void irq_clear_stats(void)
+{
+	int n;
+
+	for (n = 0; n < IRQ_NR; n++) {
+		irq_stats[n].count = 0;
+		irq_stats[n].max_latency = 0;
+		irq_stats[n].max_cycles = 0;
+	}
+}
+
+// handler of n with irqs off, or with everything of its priority and below
+// masked in the VICs and irqs on, so only higher priorities get in
+static void _dispatch(int n, unsigned int entry)
+{
+	struct irq_desc * d = &irq_descs[n];
+	struct irq_stat * s = &irq_stats[n];
+	unsigned int masked[4], start, t, flags;
+	int v, p;
+
+	start = pmu_get_cycles();
+	if (start - entry > s->max_latency)
+		s->max_latency = start - entry;
+	s->count++;
+
+	if (!irq_nesting) {
+		d->handler(d->ctx);
+	} else {
+		for (v = 0; v < 4; v++) {
+			masked[v] = 0;
+			for (p = d->prio; p < IRQ_PRIOS; p++)
+				masked[v] |= irq_prio_mask[p][v];
+			masked[v] &= VIC_INTENABLE(v);
+			VIC_INTENCLEAR(v) = masked[v];
+		}
+
+		// asm_IRQ_handler already moved to SVC mode, lr_irq is safe
+		flags = irq_save();
+		irq_restore(flags & ~0x80);
+		d->handler(d->ctx);
+		irq_restore(flags);
+
+		// not what the handler, or one nested in it, turned off meanwhile
+		for (v = 0; v < 4; v++)
+			VIC_INTENABLE(v) = masked[v] & irq_enabled[v];
+	}
+
+	t = pmu_get_cycles() - start;
+	if (t > s->max_cycles)
+		s->max_cycles = t;
+}
+
+// from asm_IRQ_handler in SVC mode, irqs off
+void C_IRQ_handler(void)
+{
+	unsigned int status[4], pend, entry;
+	int v, p, b;
+
+	entry = pmu_get_cycles();
+
+	for (v = 0; v < 4; v++)
+		status[v] = VIC_IRQSTATUS(v);
+
+	for (p = 0; p < IRQ_PRIOS; p++)
+		for (v = 0; v < 4; v++) {
+			pend = status[v] & irq_prio_mask[p][v];
+			for (b = 0; pend; b++, pend >>= 1)
+				if (pend & 1)
+					_dispatch(v * 32 + b, entry);
+		}
+
+	// pending without a handler: keep it from firing forever
+	for (v = 0; v < 4; v++) {
+		pend = status[v];
+		for (p = 0; p < IRQ_PRIOS; p++)
+			pend &= ~irq_prio_mask[p][v];
+		if (pend) {
+			irq_enabled[v] &= ~pend;
+			VIC_INTENCLEAR(v) = pend;
+		}
+	}
+
+	// VIC1 ~ 3 are daisy chained into VIC0, each ends its own vector
+	for (v = 3; v >= 0; v--)
+		if (status[v] || v == 0)
+			VIC_ADDRESS(v) = 0;
+}
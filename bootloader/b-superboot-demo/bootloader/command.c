@@ -6,6 +6,10 @@
 #include "lcd.h"
 #include "audio.h"
 #include "fat.h"
+#include "sdhc.h"
+#include "pmu.h"
+#include "ticks.h"
+#include "command.h"
 
 int help(int argc, char * argv[])
 {
@@ -17,6 +21,10 @@ int help(int argc, char * argv[])
 	printf("loadx - load .bin file using xmodem\n");
 	printf("nand - nand read/write\n");
 	printf("bootm - boot linux kernel\n");
+	printf("sdbench - compare sd PIO copy loops\n");
+	printf("sdpar - read two sd channels concurrently\n");
+	printf("time - time <command...>: wall time, cycles and PMU events\n");
+	printf("bench - bench <command...> <N>: min/median/max of N runs\n");
 
 	return 0;
 }
@@ -321,6 +329,296 @@ int draw(int argc, char * argv[])
 	return 0;
 }
 
+// sdbench [block] [count] : read the same blocks with the word loop and
+// with the burst loop, print CCNT cycles in total and on the buffer port
+int sdbench(int argc, char * argv[])
+{
+	int blk = 0x1DC000;		// bootloader.bin, see ../main.c
+	int cnt = 64;
+	U32 mode = SDHC_pio_burst;
+	U32 start, total;
+
+	if (argc >= 2)
+		blk = atoi(argv[1]);
+
+	if (argc >= 3)
+		cnt = atoi(argv[2]);
+
+	pmu_init();
+
+	for (SDHC_pio_burst = 0; SDHC_pio_burst < 2; SDHC_pio_burst++)
+	{
+#ifdef SDHC_PIO_STATS
+		SDHC_pio_cycles = 0;
+#endif
+		start = pmu_get_cycles();
+		SDHC_ReadBlocks(blk, cnt, LOAD_FILE_ADDR);
+		total = pmu_get_cycles() - start;
+
+		printf("%s: %d blocks, total %d cycles", SDHC_pio_burst ? "burst" : "loop ", cnt, total);
+#ifdef SDHC_PIO_STATS
+		printf(", buffer port %d cycles", SDHC_pio_cycles);
+#endif
+		printf("\n");
+	}
+
+	SDHC_pio_burst = mode;
+
+	return 0;
+}
+
+// KB/s of cnt blocks read in the given CCNT cycles, 1 cycle = 1ns at 1GHz
+static int sd_kbps(int cnt, U32 cycles)
+{
+	U32 kb = (U32)cnt >> 1;		// 512-byte blocks
+	U32 us = cycles / 1000;
+
+	if (us == 0)
+		return 0;
+
+	// kb * 1000000 fits in 32 bits up to 4294 KB, past that per ms
+	if (kb < 4294)
+		return udiv(kb * 1000000, us);
+	if (us < 1000)
+		return 0;
+	return udiv(kb * 1000, us / 1000);
+}
+
+// sdpar [ch a] [ch b] [block] [count] : read from channel a alone, from
+// channel b alone, then from both at the same time into separate buffers
+int sdpar(int argc, char * argv[])
+{
+	int ch[2] = {0, 2};		// SD slot and on-board eMMC of the board
+	U32 buf[2] = {LOAD_FILE_ADDR, LOAD_FILE_ADDR + 0x1000000};
+	int blk = 0x1DC000;
+	int cnt = 64;
+	int done[2];
+	U32 start, total;
+	int i;
+
+	if (argc >= 2)
+		ch[0] = atoi(argv[1]);
+
+	if (argc >= 3)
+		ch[1] = atoi(argv[2]);
+
+	if (argc >= 4)
+		blk = atoi(argv[3]);
+
+	if (argc >= 5)
+		cnt = atoi(argv[4]);
+
+	pmu_init();
+
+	for (i = 0; i < 2; i++)
+	{
+		if (!SDHC_InitChannel(ch[i]))
+		{
+			printf("sd channel %d init failed\n", ch[i]);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		start = pmu_get_cycles();
+		SDHC_ReadBlocksCh(ch[i], blk, cnt, buf[i]);
+		total = pmu_get_cycles() - start;
+		printf("ch%d: %d blocks, %d cycles, %d KB/s\n", ch[i], cnt, total, sd_kbps(cnt, total));
+	}
+
+	start = pmu_get_cycles();
+	for (i = 0; i < 2; i++)
+	{
+		if (SDHC_ReadBlocksStart(ch[i], blk, cnt, buf[i]) != 1)
+		{
+			printf("sd channel %d read failed\n", ch[i]);
+			return -1;
+		}
+		done[i] = 0;
+	}
+
+	// drain whichever card has a block ready, the other keeps reading
+	while (!done[0] || !done[1])
+	{
+		for (i = 0; i < 2; i++)
+			if (!done[i])
+				done[i] = SDHC_ReadBlocksPoll(ch[i]);
+	}
+	total = pmu_get_cycles() - start;
+
+	printf("ch%d+ch%d: %d blocks, %d cycles, %d KB/s aggregate\n", ch[0], ch[1], cnt * 2, total, sd_kbps(cnt * 2, total));
+
+	return 0;
+}
+
+// PMU events counted around a timed command
+static const struct {
+	int event;
+	const char * name;
+} time_events[PMU_COUNTERS] = {
+	{ 0x08, "instructions" },
+	{ 0x03, "L1D refills" },
+	{ 0x01, "L1I refills" },
+	{ 0x44, "L2 misses" },
+};
+
+struct time_run {
+	unsigned int us;
+	unsigned int cycles;
+	unsigned int events[PMU_COUNTERS];
+};
+
+// CCNT and the event counters are 32 bits: 4.29s at 1GHz
+#define TIME_WRAP_US	4294967
+
+// printf() here has no %u and no widths: v in decimal, right aligned in
+// width with pad in front
+static char * utoa_pad(unsigned int v, int width, char pad, char * buf)
+{
+	char tmp[12];
+	int n = 0, i = 0;
+
+	do
+	{
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (width-- > n)
+		buf[i++] = pad;
+	while (n)
+		buf[i++] = tmp[--n];
+	buf[i] = '\0';
+
+	return buf;
+}
+
+static void time_command(int argc, char * argv[], struct time_run * r)
+{
+	unsigned long long t;
+	unsigned int c;
+	int i;
+
+	pmu_init();
+	for (i = 0; i < PMU_COUNTERS; i++)
+		pmu_event_init(i, time_events[i].event);
+
+	t = get_ticks();
+	c = pmu_get_cycles();
+	command_do(argc, argv);
+	r->cycles = pmu_get_cycles() - c;
+	for (i = 0; i < PMU_COUNTERS; i++)
+		r->events[i] = pmu_get_event(i);
+	r->us = get_ticks() - t;
+}
+
+static void time_wrap_note(unsigned int us)
+{
+	if (us >= TIME_WRAP_US)
+		printf("(over 4.29s: the cycle and event counts have wrapped)\n");
+}
+
+// time <command...>
+int time(int argc, char * argv[])
+{
+	struct time_run r;
+	char a[12], b[12];
+	int i;
+
+	if (argc < 2)
+	{
+		printf("usage: time <command...>\n");
+		return -1;
+	}
+
+	time_command(argc - 1, argv + 1, &r);
+
+	printf("time: %s.", utoa_pad(r.us / 1000, 0, ' ', a));
+	printf("%s ms, %s cycles\n", utoa_pad(r.us % 1000, 3, '0', a), utoa_pad(r.cycles, 0, ' ', b));
+	for (i = 0; i < PMU_COUNTERS; i++)
+		printf("      %s %s\n", utoa_pad(r.events[i], 0, ' ', a), time_events[i].name);
+	time_wrap_note(r.us);
+
+	return 0;
+}
+
+#define BENCH_MAX	64
+
+static unsigned int bench_us[BENCH_MAX];
+static unsigned int bench_cycles[BENCH_MAX];
+static unsigned int bench_events[PMU_COUNTERS][BENCH_MAX];
+
+static void sort_u32(unsigned int * a, int n)
+{
+	unsigned int v;
+	int i, j;
+
+	for (i = 1; i < n; i++)
+	{
+		v = a[i];
+		for (j = i; j > 0 && a[j - 1] > v; j--)
+			a[j] = a[j - 1];
+		a[j] = v;
+	}
+}
+
+// min / median / max of n sorted values
+static void bench_line(const char * what, unsigned int * a, int n)
+{
+	char buf[12];
+	int i;
+
+	sort_u32(a, n);
+	printf("%s", what);
+	for (i = 0; what[i] && i < 14; i++)
+		;
+	for (; i < 14; i++)
+		putchar(' ');
+	printf(" %s", utoa_pad(a[0], 10, ' ', buf));
+	printf(" %s", utoa_pad(a[n / 2], 10, ' ', buf));
+	printf(" %s\n", utoa_pad(a[n - 1], 10, ' ', buf));
+}
+
+// bench <command...> <N>: each column sorted on its own, so a median run
+// need not be the same run in every row
+int bench(int argc, char * argv[])
+{
+	struct time_run r;
+	int n, i, k;
+
+	if (argc < 3)
+	{
+		printf("usage: bench <command...> <N>\n");
+		return -1;
+	}
+
+	n = atoi(argv[argc - 1]);
+	if (n < 1)
+		n = 1;
+	if (n > BENCH_MAX)
+		n = BENCH_MAX;
+
+	for (i = 0; i < n; i++)
+	{
+		time_command(argc - 2, argv + 1, &r);
+		bench_us[i] = r.us;
+		bench_cycles[i] = r.cycles;
+		for (k = 0; k < PMU_COUNTERS; k++)
+			bench_events[k][i] = r.events[k];
+	}
+
+	printf("bench: %d runs of <%s>\n", n, argv[1]);
+	printf("                      min     median        max\n");
+	bench_line("us", bench_us, n);
+	bench_line("cycles", bench_cycles, n);
+	for (k = 0; k < PMU_COUNTERS; k++)
+		bench_line(time_events[k].name, bench_events[k], n);
+	time_wrap_note(bench_us[n - 1]);
+
+	return 0;
+}
+
 int command_do(int argc, char * argv[])
 {
 	if (argc == 0)
@@ -361,5 +659,17 @@ int command_do(int argc, char * argv[])
 	if (strcmp(argv[0], "draw") == 0)
 		draw(argc, argv);
 
+	if (strcmp(argv[0], "sdbench") == 0)
+		sdbench(argc, argv);
+
+	if (strcmp(argv[0], "sdpar") == 0)
+		sdpar(argc, argv);
+
+	if (strcmp(argv[0], "time") == 0)
+		time(argc, argv);
+
+	if (strcmp(argv[0], "bench") == 0)
+		bench(argc, argv);
+
 	return 0;
 }
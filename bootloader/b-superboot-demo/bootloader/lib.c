@@ -1,12 +1,11 @@
 
 #include "uart.h"
+#include "ticks.h"
 
+// one second, e.g. the xmodem countdown
 void delay(void)
 {
-	int i;
-	
-	for (i = 0; i < 0x4000000; i++)
-		;
+	mdelay(1000);
 }
 
 int atoi(char * buf)
@@ -40,8 +39,36 @@ int atoi(char * buf)
 	return value;
 }
 
+// a word has a 0 byte if (w - 0x01010101) & ~w & 0x80808080
+#define HAS_ZERO(w)	(((w) - 0x01010101) & ~(w) & 0x80808080)
+
+// a word at a time while both strings sit at the same offset in a word
 int strcmp(const char * s1, const char * s2)
 {
+	const unsigned int * w1, * w2;
+
+	if ((((int)s1 ^ (int)s2) & 3) == 0)
+	{
+		while (((int)s1 & 3) && *s1 && *s1 == *s2)
+		{
+			s1++;
+			s2++;
+		}
+
+		if (((int)s1 & 3) == 0)
+		{
+			w1 = (const unsigned int *)s1;
+			w2 = (const unsigned int *)s2;
+			while (*w1 == *w2 && !HAS_ZERO(*w1))
+			{
+				w1++;
+				w2++;
+			}
+			s1 = (const char *)w1;
+			s2 = (const char *)w2;
+		}
+	}
+
 	while (*s1 == *s2)
 	{
 		if (*s1 == '\0')
@@ -91,19 +118,6 @@ char * strncpy ( char * dst, const char * src, int count )
 	return(start);
 }
 
-void *memcpy(void *dest, const void *src, int count)
-{
-	// assert( (dest!=NULL)&&(src!=NULL) );
-
-	 char *tmp_dest = (char*)dest;
-	 char *tmp_src = (char*)src;
-
-	 while( count--)//不对是否存在重叠区域进行判断
-		  *tmp_dest++ = *tmp_src++;
-
-	 return dest;
-}
-
 /*
  * state: 
  * 0: start
@@ -197,5 +211,31 @@ char * get_key_value(const char * key, char * buf, char * value)
 	return value;
 }
 
+// n / d without a divide instruction or libgcc, shift and subtract
+unsigned int udiv(unsigned int n, unsigned int d)
+{
+	unsigned int q = 0;
+	unsigned int bit = 1;
+
+	if (d == 0)
+		return 0;
+
+	while (d < n && !(d & 0x80000000))
+	{
+		d <<= 1;
+		bit <<= 1;
+	}
 
+	while (bit)
+	{
+		if (n >= d)
+		{
+			n -= d;
+			q |= bit;
+		}
+		d >>= 1;
+		bit >>= 1;
+	}
 
+	return q;
+}
@@ -1,4 +1,5 @@
 
+// 1s on the ticks.c time base
 void delay(void);
 
 int atoi(char * buf);
@@ -9,8 +10,13 @@ void putchar_hex(char c);
 
 void putint_hex(int a);
 
+// string.s: ldm/stm 32 bytes a step, memmove handles overlap
 void *memcpy(void *dest, const void *src, int count);
 
+void *memmove(void *dest, const void *src, int count);
+
+void *memset(void *s, int c, int count);
+
 char * strncpy ( char * dest, const char * source, int count );
 
 char* strcpy(char * dst, const char * src);
@@ -18,3 +24,5 @@ char* strcpy(char * dst, const char * src);
 int strncmp ( char * s1, char * s2, int n);
 
 char * get_key_value(const char * key, char * buf, char * value);
+
+unsigned int udiv(unsigned int n, unsigned int d);
@@ -9,6 +9,7 @@
 #include "fat.h"
 #include "lcd.h"
 #include "audio.h"
+#include "ticks.h"
 
 int mymain(void)
 {
@@ -60,18 +61,20 @@ int mymain(void)
 
 	printf("please enter a key to shell mode in 3 seconds... \n");
 	
-	while (i < 0x400000)
+	// 3 2 1, a second each, any key stops it
+	for (i = 3; i > 0 && flag == 0; i--)
 	{
-		if ((UTRSTAT0 & (1<<0)) == 1)
+		unsigned long long t = timeout_start(1000000);
+
+		printf("%d ", i);
+		while (!timeout_expired(t))
 		{
-			flag = 1;
-			break;
+			if ((UTRSTAT0 & (1<<0)) == 1)
+			{
+				flag = 1;
+				break;
+			}
 		}
-		
-		if ( (i & 0x0fffff) == 0 )
-			printf("%d ", 3 - (i>>20));
-			
-		i++;
 	}
 	
 	if (flag == 0)	
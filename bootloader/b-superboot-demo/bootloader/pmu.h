@@ -0,0 +1,53 @@
+
+// Cortex-A8 PMU cycle counter (CCNT), counts ARMCLK cycles (1GHz, see clock.c)
+
+static inline void pmu_init(void)
+{
+	unsigned int v;
+
+	// PMCR: [0] E = enable counters, [3] D = 0 count every cycle; CCNT is
+	// not reset, so "time sdbench" still sees it count on
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c12, 0" : "=r" (v));
+	v |= (1<<0);
+	v &= ~(1<<3);
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 0" : : "r" (v));
+
+	// PMCNTENSET: [31] enable CCNT
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" : : "r" (1<<31));
+}
+
+static inline unsigned int pmu_get_cycles(void)
+{
+	unsigned int v;
+
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r" (v));
+
+	return v;
+}
+
+// event counters 0 ~ 3 (PMCR[15:11] N = 4 on the Cortex-A8), e.g.
+// 0x01 L1I refill, 0x03 L1D refill, 0x08 instructions, 0x44 L2 miss
+#define PMU_COUNTERS	4
+
+static inline void pmu_event_init(int n, int event)
+{
+	// PMSELR picks the counter that PMXEVTYPER / PMXEVCNTR then mean
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 5" : : "r" (n));
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 4" : : "r" (0));	// isb
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c13, 1" : : "r" (event));
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c13, 2" : : "r" (0));
+
+	// PMCNTENSET: [3:0] enable counters 0 ~ 3
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" : : "r" (1<<n));
+}
+
+static inline unsigned int pmu_get_event(int n)
+{
+	unsigned int v;
+
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 5" : : "r" (n));
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 4" : : "r" (0));	// isb
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c13, 2" : "=r" (v));
+
+	return v;
+}
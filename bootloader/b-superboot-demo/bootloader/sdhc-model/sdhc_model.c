@@ -0,0 +1,618 @@
+// Behavioural model of the S5PV210 HSMMC host controller (SDHCI 2.0 register
+// set) and one SD/SDHC/eMMC card per channel, backed by an image file.
+//
+// It is register level: the driver writes ARGUMENT/TRNMOD/CMDREG, polls
+// NORINTSTS, drains BDATA, exactly as on the board. There is no timing,
+// every command and data block completes as soon as it is issued; the cost
+// of the traffic on the wires is accumulated in SDCLK cycles instead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../sdhc.h"
+
+#define SDHC_MODEL_BASE		ELFIN_HSMMC_0_BASE
+#define SDHC_MODEL_STRIDE	(ELFIN_HSMMC_1_BASE - ELFIN_HSMMC_0_BASE)
+#define SDHC_MODEL_CH_NUM	4
+
+// NORINTSTS bits
+#define INT_CMD_COMPLETE	(1<<0)
+#define INT_XFER_COMPLETE	(1<<1)
+#define INT_WRITE_READY		(1<<4)
+#define INT_READ_READY		(1<<5)
+#define INT_ERROR			(1<<15)
+
+// ERRINTSTS bits
+#define ERR_CMD_TIMEOUT		(1<<0)
+
+// R1 card status
+#define R1_OUT_OF_RANGE		(1<<31)
+#define R1_READY_FOR_DATA	(1<<8)
+#define R1_SWITCH_ERROR		(1<<7)
+#define R1_APP_CMD			(1<<5)
+
+enum { ST_IDLE, ST_READY, ST_IDENT, ST_STBY, ST_TRAN, ST_DATA, ST_RCV, ST_PRG };
+enum { DIR_NONE, DIR_READ, DIR_WRITE };
+
+struct sdhc_model_ch {
+	unsigned char reg[0x100];
+	enum sdhc_model_card type;
+
+	// card
+	unsigned char * img;
+	unsigned long img_size;
+	int state;
+	int app;				// next command is an ACMD
+	int ocr_polls;			// ACMD41/CMD1 answered busy so far
+	int switch_err;
+	unsigned int rca;
+	unsigned int width;		// data lines the card drives
+	int ddr;
+	unsigned char cid[16], csd[16];	// big endian, byte 0 = bits [127:120]
+	unsigned char scr[8];
+	unsigned char sw_status[64];
+	unsigned char ext_csd[512];
+
+	// data phase
+	int dir;
+	unsigned char * ptr;	// NULL: out of range, zeros are sent
+	unsigned int blk_size;
+	unsigned int blk_pos;
+	unsigned int blocks;
+	int auto_cmd12;
+
+	struct sdhc_model_stats st;
+};
+
+unsigned int sdhc_model_gpio[8];
+
+static struct sdhc_model_ch sdhc_model_ch[SDHC_MODEL_CH_NUM];
+
+static unsigned int reg_get(struct sdhc_model_ch * c, unsigned int off, int size)
+{
+	unsigned int v = 0;
+	int i;
+
+	for (i = size - 1; i >= 0; i--)
+		v = (v << 8) | c->reg[off + i];
+	return v;
+}
+
+static void reg_set(struct sdhc_model_ch * c, unsigned int off, int size, unsigned int v)
+{
+	int i;
+
+	for (i = 0; i < size; i++, v >>= 8)
+		c->reg[off + i] = v & 0xff;
+}
+
+// status bits only latch when enabled in NORINTSTSEN/ERRINTSTSEN
+static void raise_int(struct sdhc_model_ch * c, unsigned int bits)
+{
+	bits &= reg_get(c, oNORINTSTSEN, 2);
+	reg_set(c, oNORINTSTS, 2, reg_get(c, oNORINTSTS, 2) | bits);
+}
+
+static void raise_err(struct sdhc_model_ch * c, unsigned int bits)
+{
+	bits &= reg_get(c, oERRINTSTSEN, 2);
+	reg_set(c, oERRINTSTS, 2, reg_get(c, oERRINTSTS, 2) | bits);
+}
+
+static void host_reset(struct sdhc_model_ch * c)
+{
+	memset(c->reg, 0, sizeof(c->reg));
+	reg_set(c, oCAPAREG, 4, 0x05e80080);	// 3.3V, high speed, SDMA, ADMA2
+	reg_set(c, oHCVER, 2, 0x2401);			// SDHCI 2.0
+	c->dir = DIR_NONE;
+}
+
+// set bits [hi:lo] of a 128 bit big endian register
+static void set_bits(unsigned char * r, int hi, int lo, unsigned int v)
+{
+	int b;
+
+	for (b = lo; b <= hi; b++, v >>= 1) {
+		unsigned char * p = &r[15 - b / 8];
+
+		if (v & 1)
+			*p |= 1 << (b % 8);
+		else
+			*p &= ~(1 << (b % 8));
+	}
+}
+
+static void card_setup(struct sdhc_model_ch * c)
+{
+	unsigned long sectors = c->img_size / 512;
+
+	memset(c->cid, 0, sizeof(c->cid));
+	memset(c->csd, 0, sizeof(c->csd));
+	memset(c->scr, 0, sizeof(c->scr));
+	memset(c->sw_status, 0, sizeof(c->sw_status));
+	memset(c->ext_csd, 0, sizeof(c->ext_csd));
+
+	c->cid[0] = 0x4c;					// MID
+	memcpy(&c->cid[3], "LASOSD", 6);	// PNM, 5 chars for SD, 6 for MMC
+	c->cid[15] = 1;
+
+	if (c->type == SDHC_MODEL_SDHC) {
+		set_bits(c->csd, 127, 126, 1);	// CSD 2.0
+		set_bits(c->csd, 83, 80, 9);
+		set_bits(c->csd, 69, 48, sectors / 1024 - 1);
+	}
+	else {
+		// CSD 1.0 layout, also MMC: (C_SIZE+1) << (C_SIZE_MULT+2) << READ_BL_LEN
+		unsigned int bl_len = (c->img_size > (1UL << 30)) ? 10 : 9;
+		unsigned long c_size = (c->img_size >> (bl_len + 9)) - 1;
+
+		if (c->type == SDHC_MODEL_MMC) {
+			set_bits(c->csd, 127, 126, 3);	// version in EXT_CSD
+			set_bits(c->csd, 125, 122, 4);	// SPEC_VERS 4.x
+		}
+		if (c_size > 0xfff)
+			c_size = 0xfff;
+		set_bits(c->csd, 83, 80, bl_len);
+		set_bits(c->csd, 73, 62, c_size);
+		set_bits(c->csd, 49, 47, 7);
+	}
+	c->csd[15] = 1;
+
+	c->scr[0] = 0x02;		// SD_SPEC 2.0
+	c->scr[1] = 0x35;		// 1 and 4 bit bus
+
+	c->sw_status[13] = 0x03;	// function group 1: default and high speed
+
+	c->ext_csd[192] = 5;	// EXT_CSD_REV 4.41
+	c->ext_csd[196] = 0x07;	// HS 26/52MHz, DDR 52MHz
+	c->ext_csd[212] = sectors & 0xff;
+	c->ext_csd[213] = (sectors >> 8) & 0xff;
+	c->ext_csd[214] = (sectors >> 16) & 0xff;
+	c->ext_csd[215] = (sectors >> 24) & 0xff;
+	c->ext_csd[504] = 1;	// S_CMD_SET
+
+	c->state = ST_IDLE;
+	c->app = 0;
+	c->ocr_polls = 0;
+	c->switch_err = 0;
+	c->rca = 0;
+	c->width = 1;
+	c->ddr = 0;
+}
+
+static unsigned int r1(struct sdhc_model_ch * c)
+{
+	unsigned int s = (c->state << 9) | R1_READY_FOR_DATA;
+
+	if (c->switch_err)
+		s |= R1_SWITCH_ERROR;
+	if (c->app)
+		s |= R1_APP_CMD;
+	return s;
+}
+
+// R2: bits [127:8] of CID/CSD end up in RSPREG3[23:0]..RSPREG0
+static void set_r2(struct sdhc_model_ch * c, const unsigned char * r)
+{
+	int i, k;
+
+	for (i = 0; i < 4; i++) {
+		unsigned int v = 0;
+
+		// RSPREGi holds bits [i*32+39 : i*32+8], bytes 11-4i .. 14-4i
+		for (k = 11 - i * 4; k <= 14 - i * 4; k++)
+			v = (v << 8) | (k >= 0 ? r[k] : 0);
+		reg_set(c, oRSPREG0 + i * 4, 4, v);
+	}
+}
+
+static void data_start(struct sdhc_model_ch * c, int dir, unsigned char * ptr, unsigned int blocks)
+{
+	c->dir = dir;
+	c->ptr = ptr;
+	c->blk_size = reg_get(c, oBLKSIZE, 2) & 0xfff;
+	c->blk_pos = 0;
+	c->blocks = blocks;
+	c->auto_cmd12 = (reg_get(c, oTRNMOD, 2) >> 2) & 1;
+	c->state = (dir == DIR_READ) ? ST_DATA : ST_RCV;
+	raise_int(c, (dir == DIR_READ) ? INT_READ_READY : INT_WRITE_READY);
+}
+
+// read/write of the image, address by OCR access mode
+static void data_image(struct sdhc_model_ch * c, int dir, unsigned int arg, unsigned int * resp)
+{
+	unsigned int trnmod = reg_get(c, oTRNMOD, 2);
+	unsigned int blocks = (trnmod & (1<<5)) ? reg_get(c, oBLKCNT, 2) : 1;
+	unsigned long addr = (c->type == SDHC_MODEL_SD) ? arg : (unsigned long)arg * 512;
+	unsigned long len = (unsigned long)blocks * (reg_get(c, oBLKSIZE, 2) & 0xfff);
+	unsigned char * ptr = c->img + addr;
+
+	if (addr + len > c->img_size) {
+		fprintf(stderr, "sdhc-model: access 0x%lx+0x%lx beyond image\n", addr, len);
+		*resp |= R1_OUT_OF_RANGE;
+		ptr = NULL;
+	}
+	data_start(c, dir, ptr, blocks);
+}
+
+// returns 0 when the card does not answer (command timeout)
+static int card_cmd(struct sdhc_model_ch * c, unsigned int idx, unsigned int arg)
+{
+	int app = c->app;
+	int mmc = (c->type == SDHC_MODEL_MMC);
+	unsigned int resp = 0;
+
+	c->app = 0;
+
+	if (app && !mmc) {
+		switch (idx) {
+		case 6:		// SET_BUS_WIDTH
+			c->width = ((arg & 3) == 2) ? 4 : 1;
+			c->app = 1;
+			resp = r1(c);
+			c->app = 0;
+			goto out;
+		case 41:	// SD_SEND_OP_COND
+			resp = 0x00ff8000;
+			if (++c->ocr_polls >= 2) {
+				resp |= 1U << 31;
+				if (c->type == SDHC_MODEL_SDHC && (arg & (1<<30)))
+					resp |= 1 << 30;
+				c->state = ST_READY;
+			}
+			goto out;
+		case 51:	// SEND_SCR
+			c->app = 1;
+			resp = r1(c);
+			c->app = 0;
+			data_start(c, DIR_READ, c->scr, 1);
+			goto out;
+		}
+	}
+
+	switch (idx) {
+	case 0:
+		card_setup(c);
+		return 1;
+	case 1:		// SEND_OP_COND, MMC only
+		if (!mmc)
+			return 0;
+		resp = 0x40ff8000;		// sector access mode
+		if (++c->ocr_polls >= 2) {
+			resp |= 1U << 31;
+			c->state = ST_READY;
+		}
+		break;
+	case 2:
+		set_r2(c, c->cid);
+		c->state = ST_IDENT;
+		return 1;
+	case 3:
+		if (mmc)
+			c->rca = arg >> 16;
+		else
+			c->rca = 0x1234;
+		c->state = ST_STBY;
+		resp = mmc ? r1(c) : ((c->rca << 16) | (r1(c) & 0x1fff));
+		break;
+	case 6:
+		if (mmc) {		// SWITCH, write byte
+			unsigned int index = (arg >> 16) & 0xff, value = (arg >> 8) & 0xff;
+
+			resp = r1(c);
+			if (((arg >> 24) & 3) != 3 || (index != 183 && index != 185)) {
+				c->switch_err = 1;
+				break;
+			}
+			c->ext_csd[index] = value;
+			if (index == 183) {
+				c->width = (value & 3) == 2 ? 8 : (value & 3) == 1 ? 4 : 1;
+				c->ddr = value >= 5;
+			}
+		}
+		else {			// SWITCH_FUNC, 64 byte status
+			if ((arg >> 31) && (arg & 0xf) == 1)
+				c->sw_status[16] = 0x01;
+			resp = r1(c);
+			data_start(c, DIR_READ, c->sw_status, 1);
+		}
+		break;
+	case 7:
+		if ((arg >> 16) != c->rca) {
+			c->state = ST_STBY;
+			return 0;
+		}
+		c->state = ST_TRAN;
+		resp = r1(c);
+		break;
+	case 8:
+		if (mmc) {		// SEND_EXT_CSD
+			resp = r1(c);
+			data_start(c, DIR_READ, c->ext_csd, 1);
+		}
+		else			// SEND_IF_COND
+			resp = arg & 0xfff;
+		break;
+	case 9:
+		set_r2(c, c->csd);
+		return 1;
+	case 12:
+		c->dir = DIR_NONE;
+		c->state = ST_TRAN;
+		resp = r1(c);
+		break;
+	case 13:
+		resp = r1(c);
+		c->switch_err = 0;
+		break;
+	case 16:
+		resp = r1(c);
+		break;
+	case 17:
+	case 18:
+		resp = r1(c);
+		data_image(c, DIR_READ, arg, &resp);
+		break;
+	case 24:
+	case 25:
+		resp = r1(c);
+		data_image(c, DIR_WRITE, arg, &resp);
+		break;
+	case 55:
+		if (mmc)
+			return 0;
+		c->app = 1;
+		resp = r1(c);
+		break;
+	default:
+		return 0;
+	}
+
+out:
+	reg_set(c, oRSPREG0, 4, resp);
+	return 1;
+}
+
+static void cmd_exec(struct sdhc_model_ch * c, unsigned int cmdreg)
+{
+	unsigned int idx = (cmdreg >> 8) & 0x3f;
+	unsigned int rsp = cmdreg & 3;		// 0 none, 1 136 bit, 2 48 bit, 3 48 bit busy
+
+	c->st.cmds++;
+	c->st.cmd[idx]++;
+	if (c->app)
+		c->st.acmds++;
+	c->st.bus_clks += 48 + 8 + (rsp == 1 ? 136 : rsp ? 48 : 0);
+
+	if (!card_cmd(c, idx, reg_get(c, oARGUMENT, 4))) {
+		c->st.errors++;
+		reg_set(c, oRSPREG0, 4, 0);
+		raise_err(c, ERR_CMD_TIMEOUT);
+	}
+	// command complete is raised on timeout too, sdhc.c waits for it after
+	// every command and looks at the error bit afterwards
+	raise_int(c, INT_CMD_COMPLETE);
+}
+
+static void block_done(struct sdhc_model_ch * c)
+{
+	unsigned int wide = c->width * (c->ddr ? 2 : 1);
+	unsigned int host = reg_get(c, oHOSTCTL, 1);
+	unsigned int host_width = (host & (1<<5)) ? 8 : (host & (1<<1)) ? 4 : 1;
+
+	if (host_width != c->width)
+		fprintf(stderr, "sdhc-model: host %d bit bus, card %d bit\n", host_width, c->width);
+
+	// start bit, data, CRC16, end bit on every line
+	c->st.bus_clks += (c->blk_size * 8) / wide + 18;
+
+	c->blk_pos = 0;
+	if (--c->blocks) {
+		raise_int(c, (c->dir == DIR_READ) ? INT_READ_READY : INT_WRITE_READY);
+		return;
+	}
+
+	if (c->auto_cmd12) {
+		c->st.cmds++;
+		c->st.cmd[12]++;
+		c->st.bus_clks += 48 + 8 + 48;
+	}
+	c->dir = DIR_NONE;
+	c->state = ST_TRAN;
+	raise_int(c, INT_XFER_COMPLETE);
+}
+
+static unsigned int port_read(struct sdhc_model_ch * c)
+{
+	unsigned int v = 0;
+
+	if (c->dir != DIR_READ)
+		return 0;
+
+	if (c->ptr) {
+		memcpy(&v, c->ptr, 4);
+		c->ptr += 4;
+	}
+	c->st.bytes_rd += 4;
+	c->blk_pos += 4;
+	if (c->blk_pos >= c->blk_size)
+		block_done(c);
+	return v;
+}
+
+static void port_write(struct sdhc_model_ch * c, unsigned int v)
+{
+	if (c->dir != DIR_WRITE)
+		return;
+
+	if (c->ptr) {
+		memcpy(c->ptr, &v, 4);
+		c->ptr += 4;
+	}
+	c->st.bytes_wr += 4;
+	c->blk_pos += 4;
+	if (c->blk_pos >= c->blk_size)
+		block_done(c);
+}
+
+static struct sdhc_model_ch * addr2ch(unsigned long addr, unsigned int * off)
+{
+	unsigned long ch = (addr - SDHC_MODEL_BASE) / SDHC_MODEL_STRIDE;
+
+	*off = (addr - SDHC_MODEL_BASE) % SDHC_MODEL_STRIDE;
+	if (addr < SDHC_MODEL_BASE || ch >= SDHC_MODEL_CH_NUM || *off >= 0x100) {
+		fprintf(stderr, "sdhc-model: bad register address 0x%lx\n", addr);
+		abort();
+	}
+	return &sdhc_model_ch[ch];
+}
+
+unsigned int sdhc_model_read(unsigned long addr, int size)
+{
+	unsigned int off;
+	struct sdhc_model_ch * c = addr2ch(addr, &off);
+	unsigned int v;
+
+	c->st.reg_reads++;
+
+	switch (off) {
+	case oBDATA:
+		return port_read(c);
+	case oPRNSTS:
+		c->st.polls++;
+		v = (1<<18) | (1<<17) | (c->type ? (1<<16) : 0);
+		if (c->dir == DIR_READ)
+			v |= (1<<11) | (1<<9);
+		if (c->dir == DIR_WRITE)
+			v |= (1<<10) | (1<<8);
+		return v;
+	case oNORINTSTS:
+		c->st.polls++;
+		v = reg_get(c, oNORINTSTS, 2) & ~INT_ERROR;
+		if (reg_get(c, oERRINTSTS, 2))
+			v |= INT_ERROR;
+		if (size == 4)
+			v |= reg_get(c, oERRINTSTS, 2) << 16;
+		return v;
+	case oCLKCON:
+		c->st.polls++;
+		v = reg_get(c, oCLKCON, 2) & ~((1<<3)|(1<<1));
+		if (v & (1<<0))
+			v |= 1<<1;		// internal clock stable
+		if (v & (1<<2))
+			v |= 1<<3;		// external clock stable
+		return v;
+	}
+
+	return reg_get(c, off, size);
+}
+
+void sdhc_model_write(unsigned long addr, int size, unsigned int data)
+{
+	unsigned int off;
+	struct sdhc_model_ch * c = addr2ch(addr, &off);
+
+	c->st.reg_writes++;
+
+	switch (off) {
+	case oBDATA:
+		port_write(c, data);
+		return;
+	case oNORINTSTS:	// write 1 to clear
+		reg_set(c, oNORINTSTS, 2, reg_get(c, oNORINTSTS, 2) & ~data);
+		if (size == 4)
+			reg_set(c, oERRINTSTS, 2, reg_get(c, oERRINTSTS, 2) & ~(data >> 16));
+		return;
+	case oERRINTSTS:
+		reg_set(c, oERRINTSTS, 2, reg_get(c, oERRINTSTS, 2) & ~data);
+		return;
+	case oSWRST:
+		if (data & 1)
+			host_reset(c);
+		return;
+	}
+
+	reg_set(c, off, size, data);
+
+	if (off <= oCMDREG && off + size > oCMDREG)
+		cmd_exec(c, reg_get(c, oCMDREG, 2));
+
+	if (off <= oCLKCON && off + size > oCLKCON)
+		c->st.sdclk_div = (reg_get(c, oCLKCON, 2) >> 8) & 0xff;
+}
+
+int sdhc_model_attach(int ch, const char * image, enum sdhc_model_card type)
+{
+	struct sdhc_model_ch * c = &sdhc_model_ch[ch];
+	struct stat s;
+	int fd;
+
+	fd = open(image, O_RDWR);
+	if (fd < 0 || fstat(fd, &s) < 0) {
+		perror(image);
+		return -1;
+	}
+
+	c->img = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (c->img == MAP_FAILED) {
+		perror("mmap");
+		c->img = NULL;
+		return -1;
+	}
+	c->img_size = s.st_size;
+	c->type = type;
+
+	host_reset(c);
+	card_setup(c);
+	sdhc_model_clear_stats(ch);
+	return 0;
+}
+
+void sdhc_model_detach(int ch)
+{
+	struct sdhc_model_ch * c = &sdhc_model_ch[ch];
+
+	if (c->img)
+		munmap(c->img, c->img_size);
+	c->img = NULL;
+	c->type = SDHC_MODEL_NONE;
+}
+
+struct sdhc_model_stats * sdhc_model_get_stats(int ch)
+{
+	return &sdhc_model_ch[ch].st;
+}
+
+void sdhc_model_clear_stats(int ch)
+{
+	unsigned int div = sdhc_model_ch[ch].st.sdclk_div;
+
+	memset(&sdhc_model_ch[ch].st, 0, sizeof(struct sdhc_model_stats));
+	sdhc_model_ch[ch].st.sdclk_div = div;
+}
+
+// the timeouts of ../ticks.c, on the host clock
+static unsigned long long host_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long long timeout_start(unsigned int us)
+{
+	return host_us() + us;
+}
+
+int timeout_expired(unsigned long long deadline)
+{
+	return host_us() >= deadline;
+}
@@ -0,0 +1,52 @@
+// Host-side model of the S5PV210 HSMMC controller and an SD/MMC card.
+// sdhc.c built with -DSDHC_HOST_MODEL reaches its registers through
+// sdhc_model_read()/sdhc_model_write() instead of the bus.
+
+#ifndef __SDHC_MODEL_H__
+#define __SDHC_MODEL_H__
+
+unsigned int sdhc_model_read(unsigned long addr, int size);
+void sdhc_model_write(unsigned long addr, int size, unsigned int data);
+
+#define SDOutp32(addr,data)		sdhc_model_write((unsigned long)(addr), 4, (data))
+#define SDOutp16(addr,data)		sdhc_model_write((unsigned long)(addr), 2, (data))
+#define SDOutp8(addr,data)		sdhc_model_write((unsigned long)(addr), 1, (data))
+#define SDInp32(addr)			sdhc_model_read((unsigned long)(addr), 4)
+#define SDInp16(addr)			sdhc_model_read((unsigned long)(addr), 2)
+#define SDInp8(addr)			sdhc_model_read((unsigned long)(addr), 1)
+
+// GPGnCON/GPGnPUD, only stored
+extern unsigned int sdhc_model_gpio[8];
+#define rGPGnCON(ch)	(sdhc_model_gpio[(ch) * 2])
+#define rGPGnPUD(ch)	(sdhc_model_gpio[(ch) * 2 + 1])
+
+// card behind a channel
+enum sdhc_model_card {
+	SDHC_MODEL_NONE = 0,
+	SDHC_MODEL_SD,		// SD 2.0 standard capacity, byte addressed
+	SDHC_MODEL_SDHC,	// SD 2.0 high capacity, block addressed
+	SDHC_MODEL_MMC		// eMMC 4.41, sector addressed, high speed 52MHz
+};
+
+struct sdhc_model_stats {
+	unsigned long cmds;			// commands written to CMDREG
+	unsigned long cmd[64];		// per command index
+	unsigned long acmds;		// of them after CMD55
+	unsigned long errors;		// command timeouts
+	unsigned long reg_reads;
+	unsigned long reg_writes;
+	unsigned long polls;		// reads of PRNSTS, NORINTSTS and CLKCON
+	unsigned long bytes_rd;		// card -> host through the buffer port
+	unsigned long bytes_wr;		// host -> card through the buffer port
+	unsigned long bus_clks;		// SDCLK cycles the traffic needs on the wires
+	unsigned int sdclk_div;		// CLKCON[15:8], SDCLK = source / (2 * div)
+};
+
+// image is mapped shared, writes of the driver land in the file
+int sdhc_model_attach(int ch, const char * image, enum sdhc_model_card type);
+void sdhc_model_detach(int ch);
+
+struct sdhc_model_stats * sdhc_model_get_stats(int ch);
+void sdhc_model_clear_stats(int ch);
+
+#endif
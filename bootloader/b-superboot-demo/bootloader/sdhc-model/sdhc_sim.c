@@ -0,0 +1,139 @@
+// sdhc-sim: run ../sdhc.c on the PC against sdhc_model.c
+//
+// sdhc-sim [-t sd|sdhc|mmc] [-c channel] [-w] [-f source_hz] image [start block] [count]
+//
+// Initialises the card, reads count blocks, checks them against the image
+// and prints what the driver did on the registers: commands, polls, bytes
+// and the SDCLK cycles of the traffic. -w writes the blocks back as well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "../sdhc.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void show(const char * what, int ch, double secs, unsigned long blocks, unsigned long src_hz)
+{
+	struct sdhc_model_stats * st = sdhc_model_get_stats(ch);
+	unsigned long sdclk = src_hz / (st->sdclk_div ? 2 * st->sdclk_div : 1);
+	int i;
+
+	printf("%s:\n", what);
+	printf("  commands %lu (acmd %lu, timeout %lu):", st->cmds, st->acmds, st->errors);
+	for (i = 0; i < 64; i++)
+		if (st->cmd[i])
+			printf(" CMD%d x%lu", i, st->cmd[i]);
+	printf("\n");
+	printf("  registers %lu reads, %lu writes, %lu status polls\n",
+		st->reg_reads, st->reg_writes, st->polls);
+	printf("  buffer port %lu bytes read, %lu bytes written\n", st->bytes_rd, st->bytes_wr);
+	if (blocks)
+		printf("  per block: %.1f register accesses, %.1f polls\n",
+			(double)(st->reg_reads + st->reg_writes) / blocks, (double)st->polls / blocks);
+	printf("  bus %lu SDCLK = %.3f ms at %lu Hz", st->bus_clks, st->bus_clks * 1e3 / sdclk, sdclk);
+	if (blocks)
+		printf(", %.1f KB/s", blocks * 512 / 1024.0 / (st->bus_clks / (double)sdclk));
+	printf("\n  host %.3f ms\n", secs * 1e3);
+}
+
+int main(int argc, char * argv[])
+{
+	enum sdhc_model_card type = SDHC_MODEL_SDHC;
+	unsigned long src_hz = 133000000;
+	unsigned long start = 0, count = 64, len;
+	int ch = 0, wr = 0, opt, fd;
+	unsigned char * buf, * ref;
+	double t;
+
+	while ((opt = getopt(argc, argv, "t:c:wf:")) != -1) {
+		switch (opt) {
+		case 't':
+			type = !strcmp(optarg, "sd") ? SDHC_MODEL_SD :
+				!strcmp(optarg, "mmc") ? SDHC_MODEL_MMC : SDHC_MODEL_SDHC;
+			break;
+		case 'c':
+			ch = atoi(optarg) & 3;
+			break;
+		case 'w':
+			wr = 1;
+			break;
+		case 'f':
+			src_hz = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t sd|sdhc|mmc] [-c channel] [-w] [-f source_hz] image [start block] [count]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "no image\n");
+		return 1;
+	}
+	if (optind + 1 < argc)
+		start = strtoul(argv[optind + 1], NULL, 0);
+	if (optind + 2 < argc)
+		count = strtoul(argv[optind + 2], NULL, 0);
+	if (count == 0 || count > 0xffff) {
+		fprintf(stderr, "count must be 1 ~ 65535\n");
+		return 1;
+	}
+	len = count * 512;
+
+	if (sdhc_model_attach(ch, argv[optind], type) < 0)
+		return 1;
+
+	t = now();
+	if (!SDHC_InitChannel(ch)) {
+		fprintf(stderr, "SDHC_InitChannel(%d) failed\n", ch);
+		return 1;
+	}
+	show("init", ch, now() - t, 0, src_hz);
+
+	// the driver takes the buffer as U32, keep it below 4GB
+	buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	ref = malloc(len);
+	fd = open(argv[optind], O_RDONLY);
+	if (buf == MAP_FAILED || !ref || fd < 0 || pread(fd, ref, len, start * 512) != (ssize_t)len) {
+		fprintf(stderr, "can not set up %lu blocks at %lu\n", count, start);
+		return 1;
+	}
+
+	sdhc_model_clear_stats(ch);
+	t = now();
+	if (SDHC_ReadBlocksCh(ch, start, count, (U32)(unsigned long)buf) != 1) {
+		fprintf(stderr, "SDHC_ReadBlocksCh failed\n");
+		return 1;
+	}
+	show("read", ch, now() - t, count, src_hz);
+	if (memcmp(buf, ref, len)) {
+		fprintf(stderr, "read data differs from the image\n");
+		return 1;
+	}
+	printf("  data ok\n");
+
+	if (wr) {
+		sdhc_model_clear_stats(ch);
+		t = now();
+		// 0 is success here, 3/4/5 as for reads
+		if (SDHC_WriteBlocksCh(ch, start, count, (U32)(unsigned long)buf) != 0) {
+			fprintf(stderr, "SDHC_WriteBlocksCh failed\n");
+			return 1;
+		}
+		show("write", ch, now() - t, count, src_hz);
+	}
+
+	sdhc_model_detach(ch);
+	return 0;
+}
@@ -1,6 +1,10 @@
 #include "sdhc.h"
 #include "uart.h"
 #include "stdio.h"
+#include "ticks.h"
+#ifdef SDHC_PIO_STATS
+#include "pmu.h"
+#endif
 
 //#define	debug		printf
 
@@ -70,6 +74,7 @@ typedef enum _SDHC_channel{
 	SDHC_CHANNEL_0 = 0,
 	SDHC_CHANNEL_1,
 	SDHC_CHANNEL_2,
+	SDHC_CHANNEL_3,
 	SDHC_CHANNEL_CNT
 } SDHC_channel;
 
@@ -138,6 +143,12 @@ typedef struct {
 	U8   m_ucSpecVer;
 	U8   m_ucHostCtrlReg;
 	U8   m_ucBandwidth;
+	U8   m_ucHasExtCsd;			// eMMC EXT_CSD was read (MMC 4.x)
+	U8   m_ucExtCsdRev;			// eMMC EXT_CSD_REV, 0 is MMC 4.0
+	U8   m_ucMmcCardType;		// eMMC EXT_CSD[CARD_TYPE]
+	U8   m_ucDdr;				// eMMC in DDR mode
+	U32  m_uSectorCount;		// eMMC EXT_CSD[SEC_COUNT]
+	U32  m_uCardSize;			// from the CSD, 512 byte blocks
 	U32 * m_uBufferPtr;
 	// -- Card Information
 	U32 m_uStartBlockPos;		// startBlock Position. - for Test Case usage.
@@ -194,17 +205,50 @@ typedef struct {
 #define	SDHC_ADMA_LENGTH_MISMATCH_ERR		(1<<2)
 #define	SDHC_ADMA_ERROR_STATUS				(1<<0)
 
+// SDHC_HOST_MODEL: sdhc_model.h (included by sdhc.h) routes them to the model
+#ifndef SDHC_HOST_MODEL
 #define SDOutp32(addr,data)		*((volatile unsigned int*)(addr))=data
 #define SDOutp16(addr,data)		*((volatile unsigned short*)(addr))=data
 #define SDOutp8(addr,data)		*((volatile unsigned char*)(addr))=data
 #define SDInp32(addr)			*((volatile unsigned int*)(addr))
 #define SDInp16(addr)			*((volatile unsigned short*)(addr))
 #define SDInp8(addr)			*((volatile unsigned char*)(addr))
+#endif
 #define SDHC_MMC_HIGH_SPEED_CLOCK 20000000
 #define SDHC_SD_HIGH_SPEED_CLOCK 25000000
 
+// eMMC EXT_CSD byte index (JESD84)
+#define SDHC_EXT_CSD_BUS_WIDTH		183
+#define SDHC_EXT_CSD_HS_TIMING		185
+#define SDHC_EXT_CSD_REV			192
+#define SDHC_EXT_CSD_CARD_TYPE		196
+#define SDHC_EXT_CSD_SEC_COUNT		212
+
+// EXT_CSD[CARD_TYPE] bits
+#define SDHC_MMC_TYPE_HS_26			(1<<0)
+#define SDHC_MMC_TYPE_HS_52			(1<<1)
+#define SDHC_MMC_TYPE_DDR_52		(1<<2)	// 1.8V or 3V I/O
+
+// SDHC_MMC_DDR switches eMMC to dual data rate (BUS_WIDTH 5/6). The S5PV210
+// host (SDHCI 2.0) has no DDR sampling, define it only for a host that has.
+
+// PIO copy of the buffer data port, selected by "make PIO=burst|loop"
+#ifdef SDHC_PIO_BURST
+#define SDHC_PIO_BURST_DEFAULT	1
+#else
+#define SDHC_PIO_BURST_DEFAULT	0
+#endif
+
+
+SDHC SDHC_descriptor[SDHC_CHANNEL_CNT];
 
-SDHC SDHC_descriptor;
+static const U32 SDHC_base_addr[SDHC_CHANNEL_CNT] = {
+	ELFIN_HSMMC_0_BASE, ELFIN_HSMMC_1_BASE, ELFIN_HSMMC_2_BASE, ELFIN_HSMMC_3_BASE
+};
+
+static const U8 SDHC_int_num[SDHC_CHANNEL_CNT] = {
+	IRQ_HSMMC0, IRQ_HSMMC1, IRQ_HSMMC2, IRQ_HSMMC3
+};
 //////////
 // File Name : SDHC_SetBlockCountReg (Inline Macro)
 // File Description : This function set block count register.
@@ -234,14 +278,13 @@ SDHC SDHC_descriptor;
 //////////
 // File Name : SDHC_INT_WAIT_CLEAR (Inline Macro)
 // File Description : Interrupt wait and clear.
-// Input : SDHC, interrupt bit, timeout loop count 
-// Output : NONE.	// 0x7F000000 youngbo.song
+// Input : SDHC, interrupt bit, set to 0 on timeout
+// Output : NONE.	// SDHC_INT_TIMEOUT_US of get_ticks(), was a 0x7F000000 loop count
 #define SDHC_INT_WAIT_CLEAR(sCh,bit,loop) \
-	loop=0x7F000000; \
-	while ( !(SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) ) ) { \
-		if ( --loop == 0 ) { \
-			/*CONSOL_Printf( "***********Time out Error : bit : %d, Line:%d \n", bit, __LINE__ ); */\
-			break;	} } \
+	{ unsigned long long _uTimeout = timeout_start(SDHC_INT_TIMEOUT_US); \
+	loop=1; \
+	while ( loop && !(SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) ) ) \
+		loop = !timeout_expired(_uTimeout); } \
 	do { SDOutp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT, (1<<bit) ); \
 	} while( SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) );
 
@@ -266,6 +309,21 @@ SDHC SDHC_descriptor;
 	SDOutp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT, (1<<bit) ); \
 	while( SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) );
 
+// command / transfer / buffer ready, and the clock stable bits
+#define SDHC_INT_TIMEOUT_US	1000000
+#define SDHC_CLK_TIMEOUT_US	10000
+
+//////////
+// File Name : SDHC_WaitClock
+// File Description : Wait for a stable bit of CLK_CTRL.
+// Input : SDHC, bit mask
+// Output : NONE.	// gives up after SDHC_CLK_TIMEOUT_US
+static void SDHC_WaitClock(SDHC* sCh, U16 uMask) {
+	unsigned long long uTimeout = timeout_start(SDHC_CLK_TIMEOUT_US);
+
+	while ( !( SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ) & uMask ) && !timeout_expired(uTimeout) );
+}
+
 //
 // [7:6] Command Type
 // [5]  Data Present Select
@@ -285,15 +343,16 @@ const unsigned char SDHC_cmd_sfr_data[] = {
 };
 
 SDHC* SDHC_curr_card[SDHC_CHANNEL_CNT];
-unsigned int SDHC_global_card_size;
 
 
 
 
 U8 SDHC_Init(void);
 void SDHC_CloseMedia(void);
-static void SDHC_WriteOneBlock(U32 uBufAddr);
-static void SDHC_ReadOneBlock(U32 uBufAddr);
+static void SDHC_WriteOneBlock(SDHC* sCh);
+static void SDHC_ReadOneBlock(SDHC* sCh);
+U32* SDHC_ReadBufferPort(U32 uPort, U32* pBuf, int uWords);
+U32* SDHC_WriteBufferPort(U32 uPort, U32* pBuf, int uWords);
 U8 SDHC_WriteBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 static U8 SDHC_IdentifyCard(SDHC* sCh);
@@ -302,6 +361,9 @@ static void SDHC_SetSdClock(SDHC* sCh, SDHC_SpeedMode speed);
 static U8 SDHC_IssueCommand( SDHC* sCh, U16 uCmd, U32 uArg, SDHC_CommandType cType, SDHC_ResponseType rType );
 static U8 SDHC_GetSdScr(SDHC* sCh);
 static U8 SDHC_SetSDOCR(SDHC* sCh);
+static U8 SDHC_SetMmcOcr(SDHC* sCh);
+static U8 SDHC_GetMmcExtCsd(SDHC* sCh);
+static U8 SDHC_MmcSwitch(SDHC* sCh, U8 ucIndex, U8 ucValue);
 static U8 SDHC_WaitForCard2TransferState(SDHC* sCh);
 static void SDHC_ClearErrInterruptStatus(SDHC* sCh);
 static void SDHC_SetTransferModeReg(U32 MultiBlk, U32 DataDirection, U32 AutoCmd12En, U32 BlockCntEn, U32 DmaEn, SDHC* sCh);
@@ -334,6 +396,50 @@ void SDHC_ISR0(void) {
 	//INTC_ClearVectAddr();
 }
 
+void SDHC_ISR1(void) {
+	SDHC_InterruptHandler( SDHC_curr_card[SDHC_CHANNEL_1]);
+}
+
+void SDHC_ISR2(void) {
+	SDHC_InterruptHandler( SDHC_curr_card[SDHC_CHANNEL_2]);
+}
+
+void SDHC_ISR3(void) {
+	SDHC_InterruptHandler( SDHC_curr_card[SDHC_CHANNEL_3]);
+}
+
+static void (* const SDHC_isr[SDHC_CHANNEL_CNT])(void) = {
+	SDHC_ISR0, SDHC_ISR1, SDHC_ISR2, SDHC_ISR3
+};
+
+// bus width the board wires for the channel, see SDHC_BUS8_CHANNELS
+static U8 SDHC_BoardBusWidth(SDHC_channel eChannel)
+{
+	if ((eChannel == SDHC_CHANNEL_0 || eChannel == SDHC_CHANNEL_2) &&
+		(SDHC_BUS8_CHANNELS & (1 << eChannel)))
+		return 8;
+	return 4;
+}
+
+//////////
+// File Name : SDHC_SetGPIO
+// File Description : Set GPGn pins of the channel to SD function.
+// Input : SDHC channel, bus width
+// Output : NONE.
+void SDHC_SetGPIO(SDHC_channel eChannel, U8 ucBandwidth)
+{
+	// GPGn[1:0] CLK CMD, GPGn[2] CDn, GPGn[6:3] DATA[3:0]
+	rGPGnCON(eChannel) = (rGPGnCON(eChannel) & 0xf0000000) | 0x02222222;
+	rGPGnPUD(eChannel) = rGPGnPUD(eChannel) & 0xfffff000;
+
+	// 8 bit bus: DATA[7:4] come from GPG(n+1)[6:3] as function 3, only
+	// where the board wires them
+	if (ucBandwidth == 8 && SDHC_BoardBusWidth(eChannel) == 8) {
+		rGPGnCON(eChannel+1) = (rGPGnCON(eChannel+1) & ~(0xffff<<12)) | (0x3333<<12);
+		rGPGnPUD(eChannel+1) = rGPGnPUD(eChannel+1) & ~(0xff<<6);
+	}
+}
+
 /**
  * act2  |  act1  | symbol
  *   0    |    0    | NOP
@@ -453,11 +559,11 @@ void SDHC_InterruptHandler(SDHC * sCh) {
 	}
 	if( status & SDHC_BUFFER_READREADY_SIG_INT_EN ) {
 		SDHC_NORMAL_INT_CLEAR(sCh, 5 );
-		SDHC_ReadOneBlock( (U32)sCh->m_uBufferPtr );
+		SDHC_ReadOneBlock( sCh );
 	}
 	if( status & SDHC_BUFFER_WRITEREADY_SIG_INT_EN ) {
 		SDHC_NORMAL_INT_CLEAR(sCh, 4 );
-		SDHC_WriteOneBlock( (U32)sCh->m_uBufferPtr );
+		SDHC_WriteOneBlock( sCh );
 	}
 	if( status & SDHC_DMA_SIG_INT_EN ) {
 		SDHC_NORMAL_INT_CLEAR(sCh, 3 );
@@ -494,18 +600,33 @@ void SDHC_SetSdhcInterruptEnable(U16 uNormalIntStatusEn, U16 uErrorIntStatusEn,
 	SDOutp16( sCh->m_uBaseAddr+SDHC_ERROR_INT_SIGNAL_ENABLE, uErrorIntSigEn);
 }
 
+//////////
+// File Name : SDHC_Init
+// File Description : Initialize channel 0, the boot SD card.
+// Input : NONE.
+// Output : Success or Failure.
+U8 SDHC_Init(void)
+{
+	return SDHC_InitChannel(SDHC_CHANNEL_0);
+}
+
 //////////
 // File Name : SDHC_OpenMedia
 // File Description : Initialize channel information.
-// Input : SDHC Clock Source, SDHC pointer.
+// Input : SDHC channel number.
 // Output : Success or Failure.
-U8 SDHC_Init(void)
+U8 SDHC_InitChannel(U32 uChannel)
 {
 	SDHC_SpeedMode speed;
 	U32 uOperFreq = 0;
 	U32 cnt = 0;
-	SDHC* sCh = &SDHC_descriptor;
-	sCh->m_eChannel = SDHC_CHANNEL_0;
+	SDHC* sCh;
+
+	if (uChannel >= SDHC_CHANNEL_CNT)
+		return FALSE;
+
+	sCh = &SDHC_descriptor[uChannel];
+	sCh->m_eChannel = (SDHC_channel)uChannel;
 	sCh->m_eClockSource = SDHC_HCLK;
 	sCh->m_eOpMode = SDHC_POLLING_MODE;//SDHC_SDMA_MODE;
 	sCh->m_uStartBlockPos =1000;// start Block address.
@@ -515,15 +636,19 @@ U8 SDHC_Init(void)
 	sCh->m_ucHostCtrlReg = 0;
 	sCh->m_usClkCtrlReg = 0;
 	sCh->m_ucBandwidth = 4;		// bit width.
+	sCh->m_ucHasExtCsd = 0;
+	sCh->m_ucExtCsdRev = 0;
+	sCh->m_ucMmcCardType = 0;
+	sCh->m_ucDdr = 0;
+	sCh->m_uSectorCount = 0;
+	sCh->m_uCardSize = 0;
+	sCh->m_uRemainBlock = 0;
 	SDHC_curr_card[sCh->m_eChannel]=sCh;	// Pointer...
-	sCh->m_uBaseAddr = (U8*)ELFIN_HSMMC_0_BASE;
-	sCh->m_fIntFn = SDHC_ISR0;
-	sCh->m_ucIntChannelNum = 56/*IRQ_HSMMC0*/;
+	sCh->m_uBaseAddr = (U8*)SDHC_base_addr[uChannel];
+	sCh->m_fIntFn = SDHC_isr[uChannel];
+	sCh->m_ucIntChannelNum = SDHC_int_num[uChannel];
 	// GPIO Setting.
-   	//SDHC_SetGPIO(sCh->m_eChannel, sCh->m_ucBandwidth);
-	rGPGCON =(rGPGCON & 0xf0000000);
-	rGPGCON |= 0x02222222;
-	rGPGPUD = rGPGPUD & 0xfffff000;
+	SDHC_SetGPIO(sCh->m_eChannel, sCh->m_ucBandwidth);
 	
 //	printf("WorkingFreq = 0x%xMHz\n", (133000000 / (sCh->m_uClockDivision*2))/1000000 );
 	
@@ -557,6 +682,20 @@ U8 SDHC_Init(void)
 	}
 	// host controller speed setting.
 	speed = ( uOperFreq > SDHC_MMC_HIGH_SPEED_CLOCK) ? (SDHC_HIGH_SPEED) : (SDHC_NORMAL_SPEED);
+
+	// MMC 4.x: EXT_CSD tells the bus widths and timings the device supports.
+	if ( sCh->m_eCardType == SDHC_MMC_CARD && sCh->m_ucSpecVer >= 4 && SDHC_GetMmcExtCsd(sCh) ) {
+		// 8 bit only where the board wires DATA[7:4], see SDHC_BUS8_CHANNELS.
+		sCh->m_ucBandwidth = SDHC_BoardBusWidth(sCh->m_eChannel);
+		SDHC_SetGPIO(sCh->m_eChannel, sCh->m_ucBandwidth);
+
+		if ( sCh->m_ucMmcCardType & (SDHC_MMC_TYPE_HS_26|SDHC_MMC_TYPE_HS_52) ) {
+			// HS_TIMING must be set before the clock goes above 20MHz.
+			if ( !SDHC_MmcSwitch(sCh, SDHC_EXT_CSD_HS_TIMING, 1) )
+				return FALSE;
+			speed = SDHC_HIGH_SPEED;
+		}
+	}
 	SDHC_SetHostCtrlSpeedMode( speed, sCh );
 
 	SDHC_SetSdClockOnOff(0, sCh); // If the sd clock is to be changed, you need to stop sd-clock.
@@ -575,6 +714,109 @@ U8 SDHC_Init(void)
 
 	// youngbo.song
 	SDOutp32( sCh->m_uBaseAddr+SDHC_CONTROL2, SDInp32(sCh->m_uBaseAddr+SDHC_CONTROL2)|(1<<8)|(2<<9)|(1<<28));
+
+	if ( sCh->m_eCardType == SDHC_MMC_CARD )
+		printf("eMMC ch%d: EXT_CSD rev %d, %d bit%s, %s speed, %d sectors\n",
+			sCh->m_eChannel, sCh->m_ucExtCsdRev, sCh->m_ucBandwidth,
+			sCh->m_ucDdr ? " DDR" : "", (speed == SDHC_HIGH_SPEED) ? "high" : "normal",
+			sCh->m_uSectorCount);
+	return TRUE;
+}
+
+//////////
+// File Name : SDHC_SetMmcOcr
+// File Description : Get MMC OCR Register from MMC/eMMC by CMD1.
+// Input : SDHC channel
+// Output : success or failure.
+U8 SDHC_SetMmcOcr(SDHC* sCh)
+{
+	U32 i, OCR;
+
+	// Place all cards in the idle state.
+	if (!SDHC_IssueCommand( sCh, 0, 0, SDHC_CMD_BC_TYPE, SDHC_RES_NO_TYPE ) )
+		return FALSE;
+
+	for(i=0; i<500; i++)
+	{
+		// CMD1 (Ocr:2.7V~3.6V, sector access mode)
+		SDHC_IssueCommand( sCh, 1, 0x40ff8000, SDHC_CMD_BCR_TYPE, SDHC_RES_R3_TYPE );
+
+		OCR = SDInp32( sCh->m_uBaseAddr+SDHC_RSP0);
+		if (OCR&(unsigned int)((unsigned)0x1<<31))	// power up finished
+		{
+			// more than 2GB devices are sector addressed
+			sCh->m_eTransMode = (OCR&(0x1<<30)) ? SDHC_BLOCK_MODE : SDHC_BYTE_MODE;
+			SDHC_ClearErrInterruptStatus(sCh);
+
+			sCh->m_eCardType = SDHC_MMC_CARD;
+			return TRUE;
+		}
+	}
+	SDHC_ClearErrInterruptStatus(sCh);
+	return FALSE;
+}
+
+//////////
+// File Name : SDHC_GetMmcExtCsd
+// File Description : Read the 512 byte EXT_CSD of eMMC by CMD8.
+// Input : SDHC channel, card in transfer state.
+// Output : success or failure.
+U8 SDHC_GetMmcExtCsd(SDHC* sCh)
+{
+	U32 buffer[128];
+	U8* ext_csd = (U8*)buffer;
+	U32 done = 0;
+
+	SDHC_SetBlockSizeReg( sCh, 7, 512);
+	SDHC_SetBlockCountReg( sCh, 1);
+	SDHC_SetTransferModeReg(0, 1, 0, 0, 0, sCh);
+	sCh->m_uRemainBlock = 1;
+	sCh->m_uBufferPtr = buffer;
+
+	// CMD8 - SEND_EXT_CSD, it is SEND_IF_COND for SD
+	if(!SDHC_IssueCommand( sCh, 8, 0, SDHC_CMD_ADTC_TYPE, SDHC_RES_R1_TYPE ) )
+		return FALSE;
+	SDHC_ReadOneBlock( sCh );
+	SDHC_INT_WAIT_CLEAR( sCh, 1, done );	// SDHC_TRANSFERCOMPLETE_STS_INT_EN
+
+	// ext_csd[] only holds the register if the block came in whole
+	if ( !done || (SDInp16( sCh->m_uBaseAddr+SDHC_NORMAL_INT_STAT ) & (1<<15)) ) {
+		SDHC_ClearErrInterruptStatus(sCh);
+		return FALSE;
+	}
+
+	sCh->m_ucHasExtCsd = 1;
+	sCh->m_ucExtCsdRev = ext_csd[SDHC_EXT_CSD_REV];
+	sCh->m_ucMmcCardType = ext_csd[SDHC_EXT_CSD_CARD_TYPE];
+	sCh->m_uSectorCount = ext_csd[SDHC_EXT_CSD_SEC_COUNT] |
+		(ext_csd[SDHC_EXT_CSD_SEC_COUNT+1]<<8) |
+		(ext_csd[SDHC_EXT_CSD_SEC_COUNT+2]<<16) |
+		(ext_csd[SDHC_EXT_CSD_SEC_COUNT+3]<<24);
+
+	debug("EXT_CSD rev %d, card type 0x%x\n", sCh->m_ucExtCsdRev, sCh->m_ucMmcCardType);
+	return TRUE;
+}
+
+//////////
+// File Name : SDHC_MmcSwitch
+// File Description : Write one EXT_CSD byte by CMD6 SWITCH and wait for the busy end.
+// Input : SDHC channel, EXT_CSD index, value
+// Output : success or failure.
+U8 SDHC_MmcSwitch(SDHC* sCh, U8 ucIndex, U8 ucValue)
+{
+	// access 3 : write byte
+	if ( !SDHC_IssueCommand( sCh, 6, (3<<24)|(ucIndex<<16)|(ucValue<<8), SDHC_CMD_AC_TYPE, SDHC_RES_R1B_TYPE ) )
+		return FALSE;
+
+	if ( !SDHC_WaitForCard2TransferState(sCh) )
+		return FALSE;
+
+	// SWITCH_ERROR of the CMD13 status
+	if ( SDInp32( sCh->m_uBaseAddr+SDHC_RSP0 ) & (1<<7) ) {
+		printf("CMD6 switch %d=%d fail\n", ucIndex, ucValue);
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -590,12 +832,16 @@ U8 SDHC_SetSDOCR(SDHC* sCh)
 	// Place all cards in the idle state.
 	if (!SDHC_IssueCommand( sCh, 0, 0, SDHC_CMD_BC_TYPE, SDHC_RES_NO_TYPE ) )
 		return FALSE;
-
+	SDHC_ClearErrInterruptStatus(sCh);
 
 	for(i=0; i<500; i++)
 	{
 		// CMD55 (For ACMD)
 		SDHC_IssueCommand( sCh, 55, 0, SDHC_CMD_AC_TYPE, SDHC_RES_R1_TYPE );
+		// An MMC does not answer it at all (IssueCommand lets that pass),
+		// go on to CMD1 rather than asking 500 times.
+		if ( SDInp16( sCh->m_uBaseAddr+SDHC_NORMAL_INT_STAT ) & (1<<15) )
+			break;
 		// (Ocr:2.7V~3.6V)
 		SDHC_IssueCommand( sCh, 41, 0x40ff8000, SDHC_CMD_BCR_TYPE, SDHC_RES_R3_TYPE );
 
@@ -658,7 +904,7 @@ U8 SDHC_GetSdScr(SDHC* sCh) {
 	// Acmd51 - Send SCR
 	if(!SDHC_IssueCommand( sCh, 51, 0, SDHC_CMD_ADTC_TYPE, SDHC_RES_R1_TYPE ) )
 		return FALSE;
-	SDHC_ReadOneBlock( (U32)sCh->m_uBufferPtr );
+	SDHC_ReadOneBlock( sCh );
 	SDHC_INT_WAIT_CLEAR( sCh, 1, ignore );	// SDHC_TRANSFERCOMPLETE_STS_INT_EN
 
 // Transfer mode is determined by capacity register at OCR setting.
@@ -765,14 +1011,101 @@ U8 SDHC_IssueCommand( SDHC* sCh, U16 uCmd, U32 uArg, SDHC_CommandType cType, SDH
 	return TRUE;
 }
 
+//////////
+// File Name : SDHC_ReadBufferPort
+// File Description : Drain words from the buffer data port by CPU.
+//   The port is a single address, so LDM can not be used on it: in burst
+//   mode 8 LDRs from the port fill r3-r10 and one STMIA stores all of them.
+// Input : buffer data port address, target pointer, word count
+// Output : target pointer after the last word.
+U32 SDHC_pio_burst = SDHC_PIO_BURST_DEFAULT;
+#ifdef SDHC_PIO_STATS
+U32 SDHC_pio_cycles = 0;	// CCNT cycles spent on the buffer data port
+#endif
+
+U32* SDHC_ReadBufferPort(U32 uPort, U32* pBuf, int uWords)
+{
+#ifdef SDHC_PIO_STATS
+	U32 uStart = pmu_get_cycles();
+#endif
+
+#ifndef SDHC_HOST_MODEL		// the model port is a function, not an address
+	if (SDHC_pio_burst) {
+		for ( ; uWords >= 8; uWords -= 8) {
+			__asm__ __volatile__(
+				"ldr	r3, [%1]\n\t"
+				"ldr	r4, [%1]\n\t"
+				"ldr	r5, [%1]\n\t"
+				"ldr	r6, [%1]\n\t"
+				"ldr	r7, [%1]\n\t"
+				"ldr	r8, [%1]\n\t"
+				"ldr	r9, [%1]\n\t"
+				"ldr	r10, [%1]\n\t"
+				"stmia	%0!, {r3-r10}\n\t"
+				: "+r" (pBuf)
+				: "r" (uPort)
+				: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "memory");
+		}
+	}
+#endif
+
+	for ( ; uWords > 0; uWords--)
+		*pBuf++ = SDInp32( uPort );
+
+#ifdef SDHC_PIO_STATS
+	SDHC_pio_cycles += pmu_get_cycles() - uStart;
+#endif
+	return pBuf;
+}
+
+//////////
+// File Name : SDHC_WriteBufferPort
+// File Description : Fill the buffer data port with words by CPU.
+//   In burst mode one LDMIA loads r3-r10 and 8 STRs push them to the port.
+// Input : buffer data port address, source pointer, word count
+// Output : source pointer after the last word.
+U32* SDHC_WriteBufferPort(U32 uPort, U32* pBuf, int uWords)
+{
+#ifdef SDHC_PIO_STATS
+	U32 uStart = pmu_get_cycles();
+#endif
+
+#ifndef SDHC_HOST_MODEL
+	if (SDHC_pio_burst) {
+		for ( ; uWords >= 8; uWords -= 8) {
+			__asm__ __volatile__(
+				"ldmia	%0!, {r3-r10}\n\t"
+				"str	r3, [%1]\n\t"
+				"str	r4, [%1]\n\t"
+				"str	r5, [%1]\n\t"
+				"str	r6, [%1]\n\t"
+				"str	r7, [%1]\n\t"
+				"str	r8, [%1]\n\t"
+				"str	r9, [%1]\n\t"
+				"str	r10, [%1]\n\t"
+				: "+r" (pBuf)
+				: "r" (uPort)
+				: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "memory");
+		}
+	}
+#endif
+
+	for ( ; uWords > 0; uWords--)
+		SDOutp32( uPort, *pBuf++ );
+
+#ifdef SDHC_PIO_STATS
+	SDHC_pio_cycles += pmu_get_cycles() - uStart;
+#endif
+	return pBuf;
+}
+
 //////////
 // File Name : SDHC_WriteOneBlock
 // File Description : This function writes one block data by CPU transmission mode.
 // Input : SDHC( assert buffer pointer and remain data length.)
 // Output : NONE.
-void SDHC_WriteOneBlock(U32 uBufAddr) {
-	SDHC* sCh = &SDHC_descriptor;
-	U32* source_Ptr = (U32 *)uBufAddr;
+void SDHC_WriteOneBlock(SDHC* sCh) {
+	U32* source_Ptr = sCh->m_uBufferPtr;
 	int block_size;
 	int i;
 	block_size = SDInp16( (sCh)->m_uBaseAddr + SDHC_BLK_SIZE ) & 0xFFF;
@@ -783,10 +1116,7 @@ void SDHC_WriteOneBlock(U32 uBufAddr) {
 		//CONSOL_Printf( "100000 to time:%d\n", 100000-i);
 	
 	block_size = (block_size+3) >> 2;	// block_size = (block_size+3) / 4;
-	for(i=block_size; i>0; i--)	//512/4
-	{
-		SDOutp32( sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT, *source_Ptr++);
-	}
+	source_Ptr = SDHC_WriteBufferPort( (U32)(sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT), source_Ptr, block_size );
 	sCh->m_uRemainBlock--;
 	sCh->m_uBufferPtr = source_Ptr;
 }
@@ -794,14 +1124,23 @@ void SDHC_WriteOneBlock(U32 uBufAddr) {
 //////////
 // File Name : SDHC_ReadBlocks
 // File Description : This function reads user-data common usage.
-// Input : start block, block count, target buffer address, SDHC channel
+// Input : start block, block count, target buffer address
 // Output : Success or Failure
 U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr)
 {
-	U32 ignore;
-	SDHC* sCh = &SDHC_descriptor;
+	return SDHC_ReadBlocksCh(SDHC_CHANNEL_0, uStBlock, uBlocks, uBufAddr);
+}
 
-	debug("<SDHC_ReadBlocks> start=%d, size=%d\n", uStBlock, uBlocks);
+//////////
+// File Name : SDHC_ReadBlocksStart
+// File Description : Set up the transfer and issue CMD17/CMD18, return at once.
+// Input : SDHC channel, start block, block count, target buffer address
+// Output : 1 on success, error code otherwise.
+U8 SDHC_ReadBlocksStart(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr)
+{
+	SDHC* sCh = &SDHC_descriptor[uChannel];
+
+	debug("<SDHC_ReadBlocks> ch=%d start=%d, size=%d\n", uChannel, uStBlock, uBlocks);
 	
 #if 0
 	puts("SDHC_ReadBlocks : ");
@@ -842,11 +1181,61 @@ U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr)
 		}
 	}
 
+	return 1;
+}
+
+//////////
+// File Name : SDHC_ReadBlocksPoll
+// File Description : Move the blocks that are ready on the channel, never wait.
+// Input : SDHC channel
+// Output : TRUE when the transfer started by SDHC_ReadBlocksStart is complete.
+U8 SDHC_ReadBlocksPoll(U32 uChannel)
+{
+	SDHC* sCh = &SDHC_descriptor[uChannel];
+	U16 status = SDInp16( sCh->m_uBaseAddr+SDHC_NORMAL_INT_STAT );
+
+	// SDHC_InterruptHandler moves the blocks and clears transfer complete
+	if ( sCh->m_eOpMode == SDHC_INTERRUPT_MODE )
+		return (sCh->m_uRemainBlock == 0);
+
+	if ( sCh->m_uRemainBlock != 0 ) {
+		// buffer read ready, SDHC_ReadOneBlock will not spin
+		if ( sCh->m_eOpMode == SDHC_POLLING_MODE && (status & SDHC_BUFFER_READREADY_SIG_INT_EN) )
+			SDHC_ReadOneBlock( sCh );
+		// SDMA and ADMA2 count blocks in the controller
+		if ( sCh->m_eOpMode != SDHC_SDMA_MODE && sCh->m_eOpMode != SDHC_ADMA2_MODE )
+			return FALSE;
+	}
+
+	if ( !(status & SDHC_TRANSFERCOMPLETE_SIG_INT_EN) )
+		return FALSE;
+
+	SDHC_NORMAL_INT_CLEAR(sCh, 1);
+	sCh->m_uRemainBlock = 0;
+
+	return TRUE;
+}
+
+//////////
+// File Name : SDHC_ReadBlocksCh
+// File Description : This function reads user-data common usage.
+// Input : SDHC channel, start block, block count, target buffer address
+// Output : Success or Failure
+U8 SDHC_ReadBlocksCh(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr)
+{
+	U32 ignore;
+	U8 ret;
+	SDHC* sCh = &SDHC_descriptor[uChannel];
+
+	ret = SDHC_ReadBlocksStart(uChannel, uStBlock, uBlocks, uBufAddr);
+	if (ret != 1)
+		return ret;
+
 	if( sCh->m_eOpMode == SDHC_SDMA_MODE || sCh->m_eOpMode == SDHC_ADMA2_MODE ) {
 	}
 	else if( sCh->m_eOpMode == SDHC_POLLING_MODE ) {
 		while(sCh->m_uRemainBlock != 0 ) {
-			SDHC_ReadOneBlock( (U32)sCh->m_uBufferPtr );
+			SDHC_ReadOneBlock( sCh );
 		}
 	}
 	else if( sCh->m_eOpMode == SDHC_INTERRUPT_MODE ) {
@@ -867,11 +1256,15 @@ U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr)
 //////////
 // File Name : SDHC_WriteBlocks
 // File Description : This function writes user-data common usage.
-// Input : start block, block count, source buffer address, SDHC channel
+// Input : start block, block count, source buffer address
 // Output : Success or Failure
 U8 SDHC_WriteBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr) {
+	return SDHC_WriteBlocksCh(SDHC_CHANNEL_0, uStBlock, uBlocks, uBufAddr);
+}
+
+U8 SDHC_WriteBlocksCh(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr) {
 	U32 ignore;
-	SDHC* sCh = &SDHC_descriptor;
+	SDHC* sCh = &SDHC_descriptor[uChannel];
 	if(sCh->m_eTransMode == SDHC_BYTE_MODE)
 		uStBlock = uStBlock<<9;	//	 uStBlock * 512;
 
@@ -908,7 +1301,7 @@ U8 SDHC_WriteBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr) {
 	}
 	else if( sCh->m_eOpMode == SDHC_POLLING_MODE ) {
 		while(sCh->m_uRemainBlock != 0 ) {
-			SDHC_WriteOneBlock( (U32)sCh->m_uBufferPtr );
+			SDHC_WriteOneBlock( sCh );
 		}
 	}
 	else if( sCh->m_eOpMode == SDHC_INTERRUPT_MODE ) {
@@ -932,7 +1325,7 @@ void SDHC_CloseMedia(void)
 {
 	//puts("over");
 	
-	SDHC* sCh = &SDHC_descriptor;
+	SDHC* sCh = &SDHC_descriptor[SDHC_CHANNEL_0];
 	SDHC_SetSdClockOnOff(FALSE, sCh); // SDCLK Disable
 
 }
@@ -954,6 +1347,8 @@ U8 SDHC_IdentifyCard(SDHC* sCh)
 	// Check card OCR(Operation Condition Register)
 	if (SDHC_SetSDOCR(sCh))
 		sCh->m_eCardType = SDHC_SD_CARD;
+	else if (SDHC_SetMmcOcr(sCh))
+		sCh->m_eCardType = SDHC_MMC_CARD;
 	else
 		return FALSE;
 
@@ -1016,7 +1411,7 @@ U8 SDHC_SetSdCardSpeedMode(SDHC_SpeedMode eSpeedMode, SDHC* sCh)
 		puts("CMD6 fail\n");
 		return FALSE;
 	}
-	SDHC_ReadOneBlock( (U32)sCh->m_uBufferPtr );
+	SDHC_ReadOneBlock( sCh );
 	SDHC_INT_WAIT_CLEAR( sCh, 1, ignore ); // SDHC_TRANSFERCOMPLETE_STS_INT_EN
 	
 	if ( buffer[3] & (1<<9) ) { // Function Group 1 <- access mode.
@@ -1039,9 +1434,14 @@ U8 SDHC_SetSdCardSpeedMode(SDHC_SpeedMode eSpeedMode, SDHC* sCh)
 // Output : NONE
 void SDHC_SetHostCtrlSpeedMode(SDHC_SpeedMode eSpeedMode, SDHC* sCh)
 {
-
+	if ( eSpeedMode == SDHC_HIGH_SPEED && sCh->m_eCardType == SDHC_MMC_CARD ) {
+		SDOutp8( sCh->m_uBaseAddr+SDHC_HOST_CTRL,
+			SDInp8(sCh->m_uBaseAddr+SDHC_HOST_CTRL)|(1<<2) );	// High Speed mode.
+	}
+	else {
 		SDOutp8( sCh->m_uBaseAddr+SDHC_HOST_CTRL,
 			SDInp8(sCh->m_uBaseAddr+SDHC_HOST_CTRL)&~(1<<2) );	// Normal Speed mode.
+	}
 }
 
 //////////
@@ -1071,7 +1471,7 @@ void SDHC_SetSdClockOnOff(U8 uOnOff, SDHC* sCh)
  	{
 		SDOutp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL,
 			SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)|(1<<2) );		// SD Clock enable
-		while ( !( SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ) & (1<<3) ) );// SDHC_clockSource is Stable
+		SDHC_WaitClock( sCh, 1<<3 );	// SDHC_clockSource is Stable
 	}
 }
 
@@ -1092,6 +1492,11 @@ void SDHC_SetSdClock(SDHC* sCh, SDHC_SpeedMode speed)
 			SDOutp32( sCh->m_uBaseAddr+SDHC_CONTROL2, (1<<30)|(0<<15)|(0<<14)|(0x1<<8)|(sCh->m_eClockSource<<4) );
 			SDOutp32( sCh->m_uBaseAddr+SDHC_CONTROL3, (0<<31)|(0<<23)|(0<<15)|(0<<7) );
 		}
+		// MMC : feedback clock for Rx and Tx data (FCSel1, FCSel0)
+		else if ( sCh->m_eCardType == SDHC_MMC_CARD ) {
+			SDOutp32( sCh->m_uBaseAddr+SDHC_CONTROL2, (1<<30)|(1<<15)|(1<<14)|(0x1<<8)|(sCh->m_eClockSource<<4) );
+			SDOutp32( sCh->m_uBaseAddr+SDHC_CONTROL3, (1<<31)|(1<<23)|(0<<15)|(0<<7) );
+		}
 		else {
 			Assert( "Not support card type");
 		}
@@ -1102,7 +1507,7 @@ void SDHC_SetSdClock(SDHC* sCh, SDHC_SpeedMode speed)
 		(SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)&(~(0xff<<8)))|(sCh->m_uClockDivision<<8)|(1<<0) );
 
 	// CheckInternalClockStable
-	while (!(SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL )&0x2));
+	SDHC_WaitClock( sCh, 0x2 );
 
 	SDHC_SetSdClockOnOff( TRUE, sCh);
 	debug("rHM_CONTROL2 = %x\n",SDInp32( sCh->m_uBaseAddr+SDHC_CONTROL2 ));
@@ -1135,6 +1540,22 @@ U8 SDHC_SetDataTransferWidth( SDHC* sCh)
 		if( !SDHC_IssueCommand( sCh, 6, (sCh->m_ucBandwidth==1)?(0):(2), SDHC_CMD_AC_TYPE, SDHC_RES_R1_TYPE ) )
 			return FALSE;
 	}
+	// SDHC_MMC_CARD without EXT_CSD (MMC 3.x) only has the 1 bit bus.
+	else if ( sCh->m_eCardType == SDHC_MMC_CARD && !sCh->m_ucHasExtCsd ) {
+		sCh->m_ucBandwidth = 1;
+	}
+	else if ( sCh->m_eCardType == SDHC_MMC_CARD ) {
+		// BUS_WIDTH : 0->1bit, 1->4bit, 2->8bit, 5->4bit DDR, 6->8bit DDR
+		U8 ucBusWidth = (sCh->m_ucBandwidth==8) ? 2 : (sCh->m_ucBandwidth==4) ? 1 : 0;
+#ifdef SDHC_MMC_DDR
+		if ( ucBusWidth != 0 && (sCh->m_ucMmcCardType & SDHC_MMC_TYPE_DDR_52) ) {
+			ucBusWidth += 4;
+			sCh->m_ucDdr = 1;
+		}
+#endif
+		if ( !SDHC_MmcSwitch(sCh, SDHC_EXT_CSD_BUS_WIDTH, ucBusWidth) )
+			return FALSE;
+	}
 
 	// default 1 bit bus mode...
 	SDOutp8( sCh->m_uBaseAddr+SDHC_HOST_CTRL,
@@ -1182,7 +1603,7 @@ void SDHC_Set_InitClock( SDHC* sCh ) {
 		(SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)&(~(0xff<<8)))|(0x80<<8)|(1<<0) );
 
 	// CheckInternalClockStable
-	while (!(SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL )&0x2));
+	SDHC_WaitClock( sCh, 0x2 );
 	SDHC_SetSdClockOnOff( TRUE, sCh);
 	//CONSOL_Printf("rHM_CONTROL2 = %x\n",SDInp32( sCh->m_uBaseAddr+SDHC_CONTROL2 ));
 	//CONSOL_Printf("rHM_CLKCON = %x\n",SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ));
@@ -1193,9 +1614,8 @@ void SDHC_Set_InitClock( SDHC* sCh ) {
 // File Description : This function reads one block data by CPU transmission mode.
 // Input : SDHC( assert buffer pointer and remain data length.)
 // Output : NONE.
-void SDHC_ReadOneBlock(U32 uBufAddr) {
-	SDHC* sCh = &SDHC_descriptor;
-	U32* target_Ptr = (U32 *)uBufAddr;
+void SDHC_ReadOneBlock(SDHC* sCh) {
+	U32* target_Ptr = sCh->m_uBufferPtr;
 	int block_size;
 	int i;
 	
@@ -1203,7 +1623,7 @@ void SDHC_ReadOneBlock(U32 uBufAddr) {
 	//puts("SDHC_ReadOneBlock : ");
 #if 0
 	puts("SDHC_ReadOneBlock : ");
-	putx(uBufAddr);
+	putx((U32)target_Ptr);
 	puts("\n");
 #endif
 	
@@ -1215,10 +1635,7 @@ void SDHC_ReadOneBlock(U32 uBufAddr) {
 		//CONSOL_Printf( "100000 to time:%d\n", 100000-i);
 		
 	block_size = (block_size+3) >> 2;	// block_size = (block_size+3) / 4;
-	for(i=block_size; i>0; i--)
-	{
-		*target_Ptr++ = SDInp32( sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT );
-	}
+	target_Ptr = SDHC_ReadBufferPort( (U32)(sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT), target_Ptr, block_size );
 
 	sCh->m_uRemainBlock--;
 	sCh->m_uBufferPtr = target_Ptr;	
@@ -1248,7 +1665,7 @@ void SDHC_DisplayCardInformation(SDHC * sCh)
 	
 	CardSize = ((U32)(1<<sCh->m_sReadBlockLen))*(sCh->m_sCSize+1)*(1<<(sCh->m_sCSizeMult+2))/1048576;
 	OneBlockSize = (1<<sCh->m_sReadBlockLen);
-	SDHC_global_card_size = ((U32)(1<<sCh->m_sReadBlockLen))*(sCh->m_sCSize+1)*(1<<(sCh->m_sCSizeMult+2))/512;
+	sCh->m_uCardSize = ((U32)(1<<sCh->m_sReadBlockLen))*(sCh->m_sCSize+1)*(1<<(sCh->m_sCSizeMult+2))/512;
 
 #if 0	
 	puts("OneBlockSize\r\n");	
@@ -1256,7 +1673,7 @@ void SDHC_DisplayCardInformation(SDHC * sCh)
 	puts("CardSize\r\n");	
 	putx(CardSize+1);
 	puts("CardSize\r\n");	
-	putx(SDHC_global_card_size);
+	putx(sCh->m_uCardSize);
 	puts("\r\n");
 	putx((SDInp32( sCh->m_uBaseAddr+SDHC_RSP0 )));
 	puts("\r\n");
@@ -1274,7 +1691,7 @@ void SDHC_DisplayCardInformation(SDHC * sCh)
 
 	printf("One Block Size: 0x%xByte\n",OneBlockSize);
 	printf("Total Card Size: 0x%xMByte\n",CardSize+1);
-	printf("global_card_size: 0x%xMByte\n", SDHC_global_card_size);
+	printf("Card Size: 0x%x blocks\n", sCh->m_uCardSize);
 	printf("SDHC_RSP0: %x\n", SDInp32( sCh->m_uBaseAddr+SDHC_RSP0));
 	printf("SDHC_RSP1: %x\n", SDInp32( sCh->m_uBaseAddr+SDHC_RSP1));
 	printf("SDHC_RSP2: %x\n", SDInp32( sCh->m_uBaseAddr+SDHC_RSP2));
@@ -6,12 +6,55 @@ typedef unsigned char U8;
 U8 SDHC_Init(void);
 U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 
+// per channel interface, SDHC_Init()/SDHC_ReadBlocks() are channel 0
+U8 SDHC_InitChannel(U32 uChannel);
+U8 SDHC_ReadBlocksCh(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr);
+U8 SDHC_WriteBlocksCh(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr);
+
+// non-blocking read: start it on several channels, then poll each one
+// until it returns TRUE, e.g. OS image from eMMC while media streams from SD
+U8 SDHC_ReadBlocksStart(U32 uChannel, U32 uStBlock, U16 uBlocks, U32 uBufAddr);
+U8 SDHC_ReadBlocksPoll(U32 uChannel);
+
+void SDHC_ISR0(void);
+void SDHC_ISR1(void);
+void SDHC_ISR2(void);
+void SDHC_ISR3(void);
+
+// VIC interrupt numbers of the channels
+#define IRQ_HSMMC0		58
+#define IRQ_HSMMC1		59
+#define IRQ_HSMMC2		60
+#define IRQ_HSMMC3		98
+
+extern U32 SDHC_pio_burst;	// 1: LDR x8 + STMIA burst copy, 0: word loop
+#ifdef SDHC_PIO_STATS
+extern U32 SDHC_pio_cycles;
+#endif
+
+#ifdef SDHC_HOST_MODEL
+// registers and GPIO of the host-side model, see sdhc-model/
+#include "sdhc_model.h"
+#else
 #define rGPGCON		(*(volatile unsigned int *)(0xE02001A0))
 #define rGPGPUD		(*(volatile unsigned int *)(0xE02001A8))
 
+// GPG0 ~ GPG3 carry SD channel 0 ~ 3, 0x20 apart
+#define rGPGnCON(ch)	(*(volatile unsigned int *)(0xE02001A0 + (ch) * 0x20))
+#define rGPGnPUD(ch)	(*(volatile unsigned int *)(0xE02001A8 + (ch) * 0x20))
+#endif
+
+// Board: channels with DATA[7:4] wired, bit n for channel n. Only channel 0
+// (GPG1[6:3]) and 2 (GPG3[6:3]) can have them, and those pins are then lost
+// to channel 1 / 3. Here the on-board eMMC on channel 2.
+#ifndef SDHC_BUS8_CHANNELS
+#define SDHC_BUS8_CHANNELS	(1 << 2)
+#endif
+
 #define ELFIN_HSMMC_0_BASE		0xEB000000
 #define ELFIN_HSMMC_1_BASE		0xEB100000
 #define ELFIN_HSMMC_2_BASE		0xEB200000
+#define ELFIN_HSMMC_3_BASE		0xEB300000
 
 #define oSDMASYSAD				0x000
 #define oBLKSIZE				0x004
@@ -0,0 +1,158 @@
+
+@ memcpy, memmove and memset with ldm/stm, 32 bytes (8 registers) a step.
+@ Word steps need src and dst at the same offset in a word; memcpy shifts
+@ and merges whole words when they are not, memmove falls back to bytes.
+
+.global memcpy
+.global memmove
+.global memset
+
+@ void * memcpy(void * dest, const void * src, int count)
+memcpy:
+	stmfd sp!, {r0, r4-r10, lr}
+
+	@ bytes up to a word boundary of dest
+1:	tst r0, #3
+	beq 2f
+	subs r2, r2, #1
+	bmi 9f
+	ldrb r3, [r1], #1
+	strb r3, [r0], #1
+	b 1b
+
+2:	tst r1, #3
+	bne 6f
+
+	@ 32 bytes a step
+	subs r2, r2, #32
+	blt 4f
+3:	ldmia r1!, {r3-r10}
+	stmia r0!, {r3-r10}
+	subs r2, r2, #32
+	bge 3b
+4:	add r2, r2, #32
+
+	@ words
+5:	subs r2, r2, #4
+	ldrge r3, [r1], #4
+	strge r3, [r0], #4
+	bge 5b
+	add r2, r2, #4
+	b 8f
+
+	@ src is k bytes into a word: dest word = (w0 >> 8k) | (w1 << (32 - 8k))
+6:	and r12, r1, #3
+	bic r1, r1, #3
+	mov r12, r12, lsl #3
+	rsb lr, r12, #32
+	ldr r3, [r1], #4
+7:	subs r2, r2, #4
+	blt 71f
+	mov r4, r3, lsr r12
+	ldr r3, [r1], #4
+	orr r4, r4, r3, lsl lr
+	str r4, [r0], #4
+	b 7b
+71:	add r2, r2, #4
+	sub r1, r1, #4
+	add r1, r1, r12, lsr #3
+
+	@ bytes
+8:	subs r2, r2, #1
+	blt 9f
+	ldrb r3, [r1], #1
+	strb r3, [r0], #1
+	b 8b
+
+9:	ldmfd sp!, {r0, r4-r10, lr}
+	bx lr
+
+@ void * memmove(void * dest, const void * src, int count)
+memmove:
+	@ dest below src or past its end: a forward copy is safe
+	sub r3, r0, r1
+	cmp r3, r2
+	bhs memcpy
+
+	stmfd sp!, {r0, r4-r10, lr}
+	add r0, r0, r2
+	add r1, r1, r2
+
+	eor r3, r0, r1
+	tst r3, #3
+	bne 15f
+
+	@ backwards, bytes down to a word boundary
+11:	tst r0, #3
+	beq 12f
+	subs r2, r2, #1
+	bmi 19f
+	ldrb r3, [r1, #-1]!
+	strb r3, [r0, #-1]!
+	b 11b
+
+12:	subs r2, r2, #32
+	blt 14f
+13:	ldmdb r1!, {r3-r10}
+	stmdb r0!, {r3-r10}
+	subs r2, r2, #32
+	bge 13b
+14:	add r2, r2, #32
+
+141:	subs r2, r2, #4
+	ldrge r3, [r1, #-4]!
+	strge r3, [r0, #-4]!
+	bge 141b
+	add r2, r2, #4
+
+15:	subs r2, r2, #1
+	blt 19f
+	ldrb r3, [r1, #-1]!
+	strb r3, [r0, #-1]!
+	b 15b
+
+19:	ldmfd sp!, {r0, r4-r10, lr}
+	bx lr
+
+@ void * memset(void * s, int c, int count)
+memset:
+	stmfd sp!, {r0, r4-r9, lr}
+	and r1, r1, #0xff
+
+21:	tst r0, #3
+	beq 22f
+	subs r2, r2, #1
+	bmi 29f
+	strb r1, [r0], #1
+	b 21b
+
+	@ c in every byte of 8 registers
+22:	orr r1, r1, r1, lsl #8
+	orr r1, r1, r1, lsl #16
+	mov r3, r1
+	mov r4, r1
+	mov r5, r1
+	mov r6, r1
+	mov r7, r1
+	mov r8, r1
+	mov r9, r1
+
+	subs r2, r2, #32
+	blt 24f
+23:	stmia r0!, {r1, r3-r9}
+	subs r2, r2, #32
+	bge 23b
+24:	add r2, r2, #32
+
+25:	subs r2, r2, #4
+	strge r1, [r0], #4
+	bge 25b
+	add r2, r2, #4
+
+26:	subs r2, r2, #1
+	blt 29f
+	strb r1, [r0], #1
+	b 26b
+
+29:	ldmfd sp!, {r0, r4-r9, lr}
+	bx lr
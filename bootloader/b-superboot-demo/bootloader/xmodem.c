@@ -5,7 +5,7 @@
 #define EOT 0x04
 #define ACK 0x06
 
-// delay time depend on external clock setting, see lib.c
+// one second on the ticks.c time base, see lib.c
 extern void delay(void);
 
 void xmodem_recv(char *addr)
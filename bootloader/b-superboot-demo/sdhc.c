@@ -204,6 +204,13 @@ typedef struct {
 #define SDHC_MMC_HIGH_SPEED_CLOCK 20000000
 #define SDHC_SD_HIGH_SPEED_CLOCK 25000000
 
+// PIO copy of the buffer data port, selected by "make PIO=burst|loop"
+#ifdef SDHC_PIO_BURST
+#define SDHC_PIO_BURST_DEFAULT	1
+#else
+#define SDHC_PIO_BURST_DEFAULT	0
+#endif
+
 
 SDHC SDHC_descriptor;
 //////////
@@ -295,6 +302,8 @@ U8 SDHC_Init(void);
 void SDHC_CloseMedia(void);
 static void SDHC_WriteOneBlock(U32 uBufAddr);
 static void SDHC_ReadOneBlock(U32 uBufAddr);
+U32* SDHC_ReadBufferPort(U32 uPort, U32* pBuf, int uWords);
+U32* SDHC_WriteBufferPort(U32 uPort, U32* pBuf, int uWords);
 U8 SDHC_WriteBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 static U8 SDHC_IdentifyCard(SDHC* sCh);
@@ -766,6 +775,73 @@ U8 SDHC_IssueCommand( SDHC* sCh, U16 uCmd, U32 uArg, SDHC_CommandType cType, SDH
 	return TRUE;
 }
 
+//////////
+// File Name : SDHC_ReadBufferPort
+// File Description : Drain words from the buffer data port by CPU.
+//   The port is a single address, so LDM can not be used on it: in burst
+//   mode 8 LDRs from the port fill r3-r10 and one STMIA stores all of them.
+// Input : buffer data port address, target pointer, word count
+// Output : target pointer after the last word.
+U32 SDHC_pio_burst = SDHC_PIO_BURST_DEFAULT;
+
+U32* SDHC_ReadBufferPort(U32 uPort, U32* pBuf, int uWords)
+{
+	if (SDHC_pio_burst) {
+		for ( ; uWords >= 8; uWords -= 8) {
+			__asm__ __volatile__(
+				"ldr	r3, [%1]\n\t"
+				"ldr	r4, [%1]\n\t"
+				"ldr	r5, [%1]\n\t"
+				"ldr	r6, [%1]\n\t"
+				"ldr	r7, [%1]\n\t"
+				"ldr	r8, [%1]\n\t"
+				"ldr	r9, [%1]\n\t"
+				"ldr	r10, [%1]\n\t"
+				"stmia	%0!, {r3-r10}\n\t"
+				: "+r" (pBuf)
+				: "r" (uPort)
+				: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "memory");
+		}
+	}
+
+	for ( ; uWords > 0; uWords--)
+		*pBuf++ = SDInp32( uPort );
+
+	return pBuf;
+}
+
+//////////
+// File Name : SDHC_WriteBufferPort
+// File Description : Fill the buffer data port with words by CPU.
+//   In burst mode one LDMIA loads r3-r10 and 8 STRs push them to the port.
+// Input : buffer data port address, source pointer, word count
+// Output : source pointer after the last word.
+U32* SDHC_WriteBufferPort(U32 uPort, U32* pBuf, int uWords)
+{
+	if (SDHC_pio_burst) {
+		for ( ; uWords >= 8; uWords -= 8) {
+			__asm__ __volatile__(
+				"ldmia	%0!, {r3-r10}\n\t"
+				"str	r3, [%1]\n\t"
+				"str	r4, [%1]\n\t"
+				"str	r5, [%1]\n\t"
+				"str	r6, [%1]\n\t"
+				"str	r7, [%1]\n\t"
+				"str	r8, [%1]\n\t"
+				"str	r9, [%1]\n\t"
+				"str	r10, [%1]\n\t"
+				: "+r" (pBuf)
+				: "r" (uPort)
+				: "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "memory");
+		}
+	}
+
+	for ( ; uWords > 0; uWords--)
+		SDOutp32( uPort, *pBuf++ );
+
+	return pBuf;
+}
+
 //////////
 // File Name : SDHC_WriteOneBlock
 // File Description : This function writes one block data by CPU transmission mode.
@@ -784,10 +860,7 @@ void SDHC_WriteOneBlock(U32 uBufAddr) {
 		//CONSOL_Printf( "100000 to time:%d\n", 100000-i);
 	
 	block_size = (block_size+3) >> 2;	// block_size = (block_size+3) / 4;
-	for(i=block_size; i>0; i--)	//512/4
-	{
-		SDOutp32( sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT, *source_Ptr++);
-	}
+	source_Ptr = SDHC_WriteBufferPort( (U32)(sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT), source_Ptr, block_size );
 	sCh->m_uRemainBlock--;
 	sCh->m_uBufferPtr = source_Ptr;
 }
@@ -1216,10 +1289,7 @@ void SDHC_ReadOneBlock(U32 uBufAddr) {
 		//CONSOL_Printf( "100000 to time:%d\n", 100000-i);
 		
 	block_size = (block_size+3) >> 2;	// block_size = (block_size+3) / 4;
-	for(i=block_size; i>0; i--)
-	{
-		*target_Ptr++ = SDInp32( sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT );
-	}
+	target_Ptr = SDHC_ReadBufferPort( (U32)(sCh->m_uBaseAddr+SDHC_BUF_DAT_PORT), target_Ptr, block_size );
 
 	sCh->m_uRemainBlock--;
 	sCh->m_uBufferPtr = target_Ptr;	
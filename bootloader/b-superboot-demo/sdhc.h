@@ -6,6 +6,8 @@ typedef unsigned char U8;
 U8 SDHC_Init(void);
 U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr);
 
+extern U32 SDHC_pio_burst;	// 1: LDR x8 + STMIA burst copy, 0: word loop
+
 #define rGPGCON		(*(volatile unsigned int *)(0xE02001A0))
 #define rGPGPUD		(*(volatile unsigned int *)(0xE02001A8))
 
@@ -1,3 +1,7 @@
+#include "lib.h"
+#include "dma.h"
+#include "mmu.h"
+#include "audio.h"
 
 // GPIO
 #define GPICON  	(*(volatile unsigned int *)0xE0200220)	//IIS Signals
@@ -158,22 +162,142 @@ void WM8960_init(void)
 	return;
 }
 
-int audio_play_wav(int file_addr, int file_size)
+// DMA playback: DMA_PERI feeds IISTXD from a ring of AUDIO_PERIODS periods,
+// after every period that went out refill() gets it back in irq context
+#define IIS_TX_PERI		10			// I2S0_TX request of DMA_PERI
+#define AUDIO_PERIODS		2
+#define AUDIO_PERIOD_BYTES	(16*1024)		// ~93ms of 16 bits stereo 44.1KHz
+
+static short audio_ring[AUDIO_PERIODS][AUDIO_PERIOD_BYTES/2];
+
+static struct {
+	struct dma_chan * chan;
+	audio_refill_t refill;
+	void * arg;
+	int played;		// period the next dma event is for
+	int last;		// period that ends the playback, -1 while refill() has data
+	volatile int busy;
+} audio_dma;
+
+static void audio_fill(int n)
 {
-	short * p = (short *)file_addr;		// use "loadb 0x23000000" to put wav file here first
-	int offset = 0x2E;				// .wav data offset 
+	short * p = audio_ring[n];
+	int got = 0, i;
 
-	while (1)
-	{
-		while((IISCON & (1<<8)) == (1<<8));
-		
-		IISTXD = *(p + offset);
-		
-		offset++;
-		if (offset > (file_size - 0x2e) /2)		
-			break;
+	if (audio_dma.last < 0) {
+		got = audio_dma.refill(p, AUDIO_PERIOD_BYTES, audio_dma.arg);
+		if (got < AUDIO_PERIOD_BYTES)
+			audio_dma.last = n;
+		if (got < 0)
+			got = 0;
+	}
+
+	// silence after the end
+	for (i = got/2; i < AUDIO_PERIOD_BYTES/2; i++)
+		p[i] = 0;
+
+	// DMA_PERI reads the ring from SDRAM
+	cache_clean_range((unsigned int)p, AUDIO_PERIOD_BYTES);
+}
+
+static void audio_period_done(void * arg)
+{
+	int n = audio_dma.played;
+
+	if (n == audio_dma.last) {
+		audio_dma_stop();
+		return;
+	}
+
+	audio_fill(n);
+	audio_dma.played = (n + 1 == AUDIO_PERIODS) ? 0 : n + 1;
+}
+
+int audio_dma_start(audio_refill_t refill, void * arg)
+{
+	int i;
+
+	if (audio_dma.busy)
+		return -1;
+
+	audio_dma.refill = refill;
+	audio_dma.arg = arg;
+	audio_dma.played = 0;
+	audio_dma.last = -1;
+	for (i = 0; i < AUDIO_PERIODS; i++)
+		audio_fill(i);
+
+	audio_dma.busy = 1;
+	IISCON |= 1<<2;		// TXDMAACTIVE
+	audio_dma.chan = dma_peri_ring((int)audio_ring, AUDIO_PERIOD_BYTES, AUDIO_PERIODS,
+			(int)&IISTXD, IIS_TX_PERI, audio_period_done, 0);
+	if (!audio_dma.chan) {
+		IISCON &= ~(1<<2);
+		audio_dma.busy = 0;
+		return -1;
 	}
 
 	return 0;
 }
 
+void audio_dma_stop(void)
+{
+	if (!audio_dma.busy)
+		return;
+
+	dma_stop(audio_dma.chan);
+	IISCON &= ~(1<<2);
+	audio_dma.busy = 0;
+}
+
+int audio_dma_busy(void)
+{
+	return audio_dma.busy;
+}
+
+static struct {
+	char * p;
+	int left;
+} wav;
+
+static int wav_refill(short * buf, int bytes, void * arg)
+{
+	if (bytes > wav.left)
+		bytes = wav.left;
+	if (bytes < 0)
+		bytes = 0;
+
+	memcpy(buf, wav.p, bytes);
+	wav.p += bytes;
+	wav.left -= bytes;
+
+	return bytes;
+}
+
+// starts the playback and returns, use "loadb 0x23000000" to put wav file there first
+int audio_play_wav_start(int file_addr, int file_size)
+{
+	int offset = 0x2E * 2;			// .wav data offset 
+
+	// file_fat_read() gives -1 for a missing file
+	if (file_size <= offset)
+		return -1;
+
+	wav.p = (char *)file_addr + offset;
+	wav.left = file_size - offset;
+
+	return audio_dma_start(wav_refill, 0);
+}
+
+int audio_play_wav(int file_addr, int file_size)
+{
+	if (audio_play_wav_start(file_addr, file_size) < 0)
+		return -1;
+
+	// the dma irq refills, the cpu only waits here
+	while (audio_dma_busy())
+		;
+
+	return 0;
+}
+
@@ -7,4 +7,16 @@ void IIC_init(void);
 
 void WM8960_init(void);
 
+// fills buf with up to bytes of samples and returns how many it wrote,
+// fewer than asked ends the playback after them
+typedef int (*audio_refill_t)(short * buf, int bytes, void * arg);
+
+int audio_dma_start(audio_refill_t refill, void * arg);
+
+void audio_dma_stop(void);
+
+int audio_dma_busy(void);
+
+int audio_play_wav_start(int file_addr, int file_size);
+
 int audio_play_wav(int file_addr, int file_size);
@@ -1,302 +1,10 @@
 #include "stdio.h"
 #include "lib.h"
-
-typedef unsigned int u32;
-typedef unsigned char u8;
-typedef char bool;
-
-#define CMD_DMAADDH	0x54
-#define CMD_DMAEND	0x00
-#define CMD_DMAFLUSHP	0x35
-#define CMD_DMAGO	0xa0
-#define CMD_DMALD	0x04
-#define CMD_DMALDP	0x25
-#define CMD_DMALP	0x20
-#define CMD_DMALPEND	0x28
-#define CMD_DMAKILL	0x01
-#define CMD_DMAMOV	0xbc
-#define CMD_DMANOP	0x18
-#define CMD_DMARMB	0x12
-#define CMD_DMASEV	0x34
-#define CMD_DMAST	0x08
-#define CMD_DMASTP	0x29
-#define CMD_DMASTZ	0x0c
-#define CMD_DMAWFE	0x36
-#define CMD_DMAWFP	0x30
-#define CMD_DMAWMB	0x13
-
-#define SZ_DMAADDH	3
-#define SZ_DMAEND	1
-#define SZ_DMAFLUSHP	2
-#define SZ_DMALD	1
-#define SZ_DMALDP	2
-#define SZ_DMALP	2
-#define SZ_DMALPEND	2
-#define SZ_DMAKILL	1
-#define SZ_DMAMOV	6
-#define SZ_DMANOP	1
-#define SZ_DMARMB	1
-#define SZ_DMASEV	2
-#define SZ_DMAST	1
-#define SZ_DMASTP	2
-#define SZ_DMASTZ	1
-#define SZ_DMAWFE	2
-#define SZ_DMAWFP	2
-#define SZ_DMAWMB	1
-#define SZ_DMAGO	6
-
-
-enum dmamov_dst {
-	SAR = 0,
-	CCR,
-	DAR,
-};
-
-enum pl330_dst {
-	SRC = 0,
-	DST,
-};
-
-enum pl330_cond {
-	SINGLE,
-	BURST,
-	ALWAYS,
-};
-
-#define printk 	printf
-//#define PL330_DEBUG_MCGEN
-
-#ifdef PL330_DEBUG_MCGEN
-static unsigned cmd_line = 0;
-#define PL330_DBGCMD_DUMP(off, x...)	do { \
-						printk("%x:", cmd_line); \
-						printk(x); \
-						cmd_line += off; \
-					} while (0)
-#define PL330_DBGMC_START(addr)		(cmd_line = addr)
-#else
-#define PL330_DBGCMD_DUMP(off, x...)	do {} while (0)
-#define PL330_DBGMC_START(addr)		do {} while (0)
-#endif
-
-static inline u32 _emit_MOV(unsigned dry_run, u8 buf[],
-		enum dmamov_dst dst, u32 val)
-{
-	if (dry_run)
-		return SZ_DMAMOV;
-
-	buf[0] = CMD_DMAMOV;
-	buf[1] = dst;
-	//*((u32 *)&buf[2]) = val;
-	buf[2] = val & 0xff;
-	buf[3] = (val>>8) & 0xff;
-	buf[4] = (val>>16) & 0xff;
-	buf[5] = (val>>24) & 0xff;
-
-	PL330_DBGCMD_DUMP(SZ_DMAMOV, "\tDMAMOV %s 0x%x\n",
-		dst == SAR ? "SAR" : (dst == DAR ? "DAR" : "CCR"), val);
-
-	return SZ_DMAMOV;
-}
-
-static inline u32 _emit_LP(unsigned dry_run, u8 buf[],
-		unsigned loop, u8 cnt)
-{
-	if (dry_run)
-		return SZ_DMALP;
-
-	buf[0] = CMD_DMALP;
-
-	if (loop)
-		buf[0] |= (1 << 1);
-
-	cnt--; /* DMAC increments by 1 internally */
-	buf[1] = cnt;
-
-	PL330_DBGCMD_DUMP(SZ_DMALP, "\tDMALP_%c %d\n", loop ? '1' : '0', cnt);
-
-	return SZ_DMALP;
-}
-
-static inline u32 _emit_LD(unsigned dry_run, u8 buf[],	enum pl330_cond cond)
-{
-	if (dry_run)
-		return SZ_DMALD;
-
-	buf[0] = CMD_DMALD;
-
-	if (cond == SINGLE)
-		buf[0] |= (0 << 1) | (1 << 0);
-	else if (cond == BURST)
-		buf[0] |= (1 << 1) | (1 << 0);
-
-	PL330_DBGCMD_DUMP(SZ_DMALD, "\tDMALD%c\n",
-		cond == SINGLE ? 'S' : (cond == BURST ? 'B' : 'A'));
-
-	return SZ_DMALD;
-}
-
-static inline u32 _emit_ST(unsigned dry_run, u8 buf[], enum pl330_cond cond)
-{
-	if (dry_run)
-		return SZ_DMAST;
-
-	buf[0] = CMD_DMAST;
-
-	if (cond == SINGLE)
-		buf[0] |= (0 << 1) | (1 << 0);
-	else if (cond == BURST)
-		buf[0] |= (1 << 1) | (1 << 0);
-
-	PL330_DBGCMD_DUMP(SZ_DMAST, "\tDMAST%c\n",
-		cond == SINGLE ? 'S' : (cond == BURST ? 'B' : 'A'));
-
-	return SZ_DMAST;
-}
-
-struct _arg_LPEND {
-	enum pl330_cond cond;
-	char forever;
-	unsigned loop;
-	u8 bjump;
-};
-
-static inline u32 _emit_LPEND(unsigned dry_run, u8 buf[],
-		const struct _arg_LPEND *arg)
-{
-	enum pl330_cond cond = arg->cond;
-	char forever = arg->forever;
-	unsigned loop = arg->loop;
-	u8 bjump = arg->bjump;
-
-	if (dry_run)
-		return SZ_DMALPEND;
-
-	buf[0] = CMD_DMALPEND;
-
-	if (loop)
-		buf[0] |= (1 << 2);
-
-	if (!forever)
-		buf[0] |= (1 << 4);
-
-	if (cond == SINGLE)
-		buf[0] |= (0 << 1) | (1 << 0);
-	else if (cond == BURST)
-		buf[0] |= (1 << 1) | (1 << 0);
-
-	buf[1] = bjump;
-
-	PL330_DBGCMD_DUMP(SZ_DMALPEND, "\tDMALP%s%c_%c bjmpto_%x\n",
-			forever ? "FE" : "END",
-			cond == SINGLE ? 'S' : (cond == BURST ? 'B' : 'A'),
-			loop ? '1' : '0',
-			bjump);
-
-	return SZ_DMALPEND;
-}
-
-static inline u32 _emit_SEV(unsigned dry_run, u8 buf[], u8 ev)
-{
-	if (dry_run)
-		return SZ_DMASEV;
-
-	buf[0] = CMD_DMASEV;
-
-	ev &= 0x1f;
-	ev <<= 3;
-	buf[1] = ev;
-
-	PL330_DBGCMD_DUMP(SZ_DMASEV, "\tDMASEV %u\n", ev >> 3);
-
-	return SZ_DMASEV;
-}
-
-static inline u32 _emit_END(unsigned dry_run, u8 buf[])
-{
-	if (dry_run)
-		return SZ_DMAEND;
-
-	buf[0] = CMD_DMAEND;
-
-	PL330_DBGCMD_DUMP(SZ_DMAEND, "\tDMAEND\n");
-
-	return SZ_DMAEND;
-}
-
-static inline u32 _emit_FLUSHP(unsigned dry_run, u8 buf[], u8 peri)
-{
-	if (dry_run)
-		return SZ_DMAFLUSHP;
-
-	buf[0] = CMD_DMAFLUSHP;
-
-	peri &= 0x1f;
-	peri <<= 3;
-	buf[1] = peri;
-
-	PL330_DBGCMD_DUMP(SZ_DMAFLUSHP, "\tDMAFLUSHP %d\n", peri >> 3);
-
-	return SZ_DMAFLUSHP;
-}
-
-struct _xfer_spec {
-	u32 ccr;
-	//struct pl330_req *r;
-	//struct pl330_xfer *x;
-	int size;
-};
-
-struct _arg_GO {
-	u8 chan;
-	u32 addr;
-	unsigned ns;
-};
-
-static inline u32 _emit_GO(unsigned dry_run, u8 buf[],
-		const struct _arg_GO *arg)
-{
-	u8 chan = arg->chan;
-	u32 addr = arg->addr;
-	unsigned ns = arg->ns;
-
-	if (dry_run)
-		return SZ_DMAGO;
-
-	buf[0] = CMD_DMAGO;
-	buf[0] |= (ns << 1);
-
-	buf[1] = chan & 0x7;
-
-	//*((u32 *)&buf[2]) = addr;
-	buf[2] = addr & 0xff;
-	buf[3] = (addr>>8) & 0xff;
-	buf[4] = (addr>>16) & 0xff;
-	buf[5] = (addr>>24) & 0xff;
-
-	return SZ_DMAGO;
-}
-
-#define true 	1
-#define false 	0
-
-#define CC_SRCINC	(1 << 0)
-#define CC_DSTINC	(1 << 14)
-#define CC_SRCPRI	(1 << 8)
-#define CC_DSTPRI	(1 << 22)
-#define CC_SRCNS	(1 << 9)
-#define CC_DSTNS	(1 << 23)
-#define CC_SRCIA	(1 << 10)
-#define CC_DSTIA	(1 << 24)
-#define CC_SRCBRSTLEN_SHFT	4
-#define CC_DSTBRSTLEN_SHFT	18
-#define CC_SRCBRSTSIZE_SHFT	1
-#define CC_DSTBRSTSIZE_SHFT	15
-#define CC_SRCCCTRL_SHFT	11
-#define CC_SRCCCTRL_MASK	0x7
-#define CC_DSTCCTRL_SHFT	25
-#define CC_DRCCCTRL_MASK	0x7
-#define CC_SWAP_SHFT	28
+#include "dma.h"
+#include "pl330.h"
+#include "pmu.h"
+#include "mmu.h"
+#include "vic.h"
 
 static inline u32 _prepare_ccr(void)
 {
@@ -354,9 +62,17 @@ static inline u32 _prepare_ccr(const struct pl330_reqcfg *rqc)
 }
 #endif
 
+#define DBGSTATUS	0xd00
 #define DBGCMD		0xd04
 #define DBGINST0	0xd08
 #define DBGINST1	0xd0c
+#define INTEN		0x020		// DMASEV n raises irq n instead of event n
+#define INT_EVENT_RIS	0x024
+#define INTMIS		0x028		// pending irqs
+#define INTCLR		0x02c
+#define FSRC		0x034		// fault status, one bit per channel
+#define FTC(ch)		(0x040 + (ch) * 4)	// fault type of channel
+#define CS(ch)		(0x100 + (ch) * 8)	// channel status
 
 #define DMA_MEM		0xFA200000
 #define DMA_PERI	0xE0900000
@@ -368,8 +84,13 @@ void writel(int val, int addr)
 	return;
 }
 
+static inline u32 readl(int addr)
+{
+	return *(volatile unsigned int *)addr;
+}
+
 //static inline void _execute_DBGINSN(struct pl330_thread *thrd,
-static inline void _execute_DBGINSN(int dma_regs_base,
+static inline void _execute_DBGINSN(int dma_regs_base, int chan,
 		u8 insn[], bool as_manager)
 {
 //	void __iomem *regs = thrd->dmac->pinfo->base;
@@ -379,11 +100,9 @@ static inline void _execute_DBGINSN(int dma_regs_base,
 
 	val = (insn[0] << 16) | (insn[1] << 24);
 
-	//if (!as_manager) {
-	if (!1) {
+	if (!as_manager) {
 		val |= (1 << 0);
-		//val |= (thrd->id << 8); /* Channel Number */
-		val |= (0 << 8); /* Channel Number */
+		val |= (chan << 8); /* Channel Number */
 	}
 	writel(val, regs + DBGINST0);
 
@@ -394,423 +113,593 @@ static inline void _execute_DBGINSN(int dma_regs_base,
 	val |= insn[5] << 24;
 	writel(val, regs + DBGINST1);
 
-#if 0
-	/* If timed out due to halted state-machine */
-	if (_until_dmac_idle(thrd)) {
-		dev_err(thrd->dmac->pinfo->dev, "DMAC halted!\n");
-		return;
-	}
-#endif
+	/* the debug interface takes one instruction at a time */
+	while (readl(regs + DBGSTATUS) & 0x1)
+		;
 	/* Get going */
 	writel(0, regs + DBGCMD);
 }
 
-static inline u32 _emit_STP(unsigned dry_run, u8 buf[],
-		enum pl330_cond cond, u8 peri)
+/*
+ * Channel manager: the 8 threads of each DMAC are handed out by
+ * dma_request(), every thread owns the buffer its program lives in, so the
+ * microcode stays valid for as long as the DMAC runs it. A program ends with
+ * DMAWMB; DMASEV <thread>; DMAEND, INTEN turns that event into the DMAC irq
+ * (VIC0 18 for DMA_MEM, 19 for DMA_PERI) and dma_irq_handler() completes it.
+ *
+ * The buffers double as a program cache: a thread keeps the program it ran
+ * with the size and configuration it was built for, a request with the same
+ * key gets that thread back and only the DMAMOV SAR/DAR operands are patched.
+ */
+/* kind of a cached program, in bits [31:24] of its key */
+#define DMA_PROG_COPY	(1 << 24)
+#define DMA_PROG_PERI	(2 << 24)
+#define DMA_PROG_FILL	(3 << 24)
+
+static struct dma_chan dma_chans[2][DMA_CHANNELS];
+static const int dma_base[2] = { DMA_MEM, DMA_PERI };
+
+int dma_cache_hits, dma_cache_misses;
+
+void dma_init(void)
 {
-	if (dry_run)
-		return SZ_DMASTP;
+	int d;
 
-	buf[0] = CMD_DMASTP;
+	for (d = 0; d < 2; d++) {
+		writel(0xff, dma_base[d] + INTCLR);
+		writel(0xff, dma_base[d] + INTEN);
+	}
 
-	if (cond == BURST)
-		buf[0] |= (1 << 1);
+	/* the audio ring runs on DMA_PERI and may not starve */
+	irq_register(INT_PDMA0, dma_irq_handler, (void *)DMAC_PERI, 0);
+	irq_register(INT_MDMA, dma_irq_handler, (void *)DMAC_MEM, 1);
+}
 
-	peri &= 0x1f;
-	peri <<= 3;
-	buf[1] = peri;
+/*
+ * A free thread, preferably one that holds the program of (size, cfg), then
+ * an empty one, then any. *hit tells if mc already is that program.
+ * cfg 0 asks for a thread whose program the caller writes itself.
+ */
+static struct dma_chan * _request(int dmac, u32 size, u32 cfg, int * hit)
+{
+	struct dma_chan * c = 0, * t;
+	u32 flags;
+	int i;
+
+	*hit = 0;
+
+	flags = irq_save();
+	for (i = 0; i < DMA_CHANNELS; i++) {
+		t = &dma_chans[dmac][i];
+		if (t->busy)
+			continue;
+		if (cfg && t->prog_cfg == cfg && t->prog_size == size) {
+			c = t;
+			*hit = 1;
+			break;
+		}
+		if (!c || (c->prog_cfg && !t->prog_cfg))
+			c = t;
+	}
+	if (c) {
+		c->dmac = dmac;
+		c->id = c - dma_chans[dmac];	// i is only its index after a hit
+		c->busy = 1;
+		c->done = 0;
+		c->fault = 0;
+		c->autofree = 0;
+		c->cyclic = 0;
+		c->callback = 0;
+		c->arg = 0;
+		c->prog_size = size;
+		c->prog_cfg = cfg;
+	}
+	irq_restore(flags);
 
-	PL330_DBGCMD_DUMP(SZ_DMASTP, "\tDMASTP%c %u\n",
-		cond == SINGLE ? 'S' : 'B', peri >> 3);
+	if (cfg) {
+		if (*hit)
+			dma_cache_hits++;
+		else
+			dma_cache_misses++;
+	}
 
-	return SZ_DMASTP;
+	return c;
 }
 
+struct dma_chan * dma_request(int dmac)
+{
+	int hit;
+
+	return _request(dmac, 0, 0, &hit);
+}
 
-static inline u32 _emit_WFP(unsigned dry_run, u8 buf[],
-		enum pl330_cond cond, u8 peri)
+/* point a cached program at new addresses */
+static inline void _patch_addr(struct dma_chan * c, u32 src, u32 dst)
 {
-	if (dry_run)
-		return SZ_DMAWFP;
+	_emit_MOV(0, &c->mc[c->sar], SAR, src);
+	_emit_MOV(0, &c->mc[c->dar], DAR, dst);
+}
 
-	buf[0] = CMD_DMAWFP;
+void dma_release(struct dma_chan * chan)
+{
+	chan->busy = 0;
+}
 
-	if (cond == SINGLE)
-		buf[0] |= (0 << 1) | (0 << 0);
-	else if (cond == BURST)
-		buf[0] |= (1 << 1) | (0 << 0);
-	else
-		buf[0] |= (0 << 1) | (1 << 0);
+/* run chan->mc on the channel, the program must end with DMASEV chan->id */
+void dma_start(struct dma_chan * chan)
+{
+	int base = dma_base[chan->dmac];
+	struct _arg_GO go;
+	u8 insn[6] = {0, 0, 0, 0, 0, 0};
 
-	peri &= 0x1f;
-	peri <<= 3;
-	buf[1] = peri;
+	chan->done = 0;
+	chan->fault = 0;
 
-	PL330_DBGCMD_DUMP(SZ_DMAWFP, "\tDMAWFP%c %u\n",
-		cond == SINGLE ? 'S' : (cond == BURST ? 'B' : 'P'), peri >> 3);
+	/* the DMAC fetches the program from memory, not from the D-cache */
+	cache_clean_range((u32)chan->mc, DMA_MC_SIZE);
 
-	return SZ_DMAWFP;
+	/* the last user may still be on its DMAEND, DMAGO is ignored until then */
+	while (readl(base + CS(chan->id)) & 0xf)
+		;
+
+	go.chan = chan->id;
+	go.addr = (int)chan->mc;
+	go.ns = chan->dmac == DMAC_PERI;	// DMA_peri must be non-secure
+	_emit_GO(0, insn, &go);
+
+	_execute_DBGINSN(base, 0, insn, true);
 }
 
-static inline int _ldst_memtomem_nobarrier(unsigned dry_run, u8 buf[],
-		const struct _xfer_spec *pxs, int cyc)
+/* kill a running channel and release it, also from its own callback */
+void dma_stop(struct dma_chan * chan)
 {
-	int off = 0;
+	u8 kill[6] = {CMD_DMAKILL, 0, 0, 0, 0, 0};
 
-	while (cyc--) {
-		off += _emit_LD(dry_run, &buf[off], ALWAYS);
-		off += _emit_ST(dry_run, &buf[off], ALWAYS);
+	_execute_DBGINSN(dma_base[chan->dmac], chan->id, kill, false);
+	chan->done = 1;
+	dma_release(chan);
+}
+
+/* complete the finished or faulted channels of a DMAC, called with irqs off */
+static void _service(int dmac)
+{
+	int base = dma_base[dmac];
+	u8 kill[6] = {CMD_DMAKILL, 0, 0, 0, 0, 0};
+	struct dma_chan * c;
+	u32 pend, fault;
+	int i;
+
+	fault = readl(base + FSRC);
+	pend = readl(base + INTMIS) | fault;
+
+	for (i = 0; i < DMA_CHANNELS; i++) {
+		if (!(pend & (1 << i)))
+			continue;
+
+		c = &dma_chans[dmac][i];
+		if (fault & (1 << i)) {
+			c->fault = readl(base + FTC(i));
+			printk("dma %d channel %d fault 0x%x\n", dmac, i, c->fault);
+			_execute_DBGINSN(base, i, kill, false);
+		}
+		writel(1 << i, base + INTCLR);
+
+		if (!c->busy || c->done)
+			continue;
+		if (c->cyclic && !c->fault) {
+			// one period of a program that runs until dma_stop()
+			if (c->callback)
+				c->callback(c->arg);
+			continue;
+		}
+		c->done = 1;
+		if (c->callback)
+			c->callback(c->arg);
+		if (c->autofree)
+			c->busy = 0;
 	}
+}
 
-	return off;
+/* from C_IRQ_handler on VIC0 18/19, ctx is the DMAC */
+void dma_irq_handler(void * ctx)
+{
+	_service((int)ctx);
 }
 
-static int _bursts(unsigned dry_run, u8 buf[],
-		const struct _xfer_spec *pxs, int cyc)
+/*
+ * Wait for a channel started without a callback and release it, -1 if it
+ * faulted. Polls the DMAC itself, so it also works with irqs off, e.g. from
+ * an irq handler.
+ */
+int dma_wait(struct dma_chan * chan)
 {
-	int off = 0;
+	u32 flags;
+	int ret;
 
-#if 0
-	switch (pxs->r->rqtype) {
-	case MEMTODEV:
-		off += _ldst_memtodev(dry_run, &buf[off], pxs, cyc);
-		break;
-	case DEVTOMEM:
-		off += _ldst_devtomem(dry_run, &buf[off], pxs, cyc);
-		break;
-	case MEMTOMEM:
-		off += _ldst_memtomem(dry_run, &buf[off], pxs, cyc);
-		break;
-	case MEMTOMEM_NOBARRIER:
-		off += _ldst_memtomem_nobarrier(dry_run, &buf[off], pxs, cyc);
-		break;
-#endif
-	off += _ldst_memtomem_nobarrier(dry_run, &buf[off], pxs, cyc);
+	while (!chan->done) {
+		flags = irq_save();
+		_service(chan->dmac);
+		irq_restore(flags);
+	}
 
-	return off;
-}
+	ret = chan->fault ? -1 : 0;
+	dma_release(chan);
 
+	return ret;
+}
 
-/* Returns bytes consumed and updates bursts */
-static inline int _loop(unsigned dry_run, u8 buf[],
-		unsigned long *bursts, 
-		const struct _xfer_spec *pxs)		
+/*
+ * The program of a copy depends on the size and on the low 7 bits of src
+ * and src ^ dst (beat size, burst length, head), which make up its key.
+ */
+static struct dma_chan * _copy_start(int dmac, int src, int dst, int size,
+		void (*callback)(void *), void * arg, int autofree)
 {
-	int cyc, cycmax, szlp, szlpend, szbrst, off;
-	unsigned lcnt0, lcnt1, ljmp0, ljmp1;
-	struct _arg_LPEND lpend;
-
-	/* Max iterations possibile in DMALP is 256 */
-	if (*bursts >= 256*256) {
-		lcnt1 = 256;
-		lcnt0 = 256;
-		//cyc = *bursts / lcnt1 / lcnt0;
-		cyc = *bursts / 256 / 256;
-	} else if (*bursts > 256) {
-		lcnt1 = 256;
-		//lcnt0 = *bursts / lcnt1;
-		lcnt0 = *bursts / 256;
-		cyc = 1;
+	u32 cfg = DMA_PROG_COPY | (((src ^ dst) & 0x7f) << 8) | (src & 0x7f);
+	int ns = dmac == DMAC_PERI;
+	struct dma_chan * c;
+	int off = 0, hit;
+
+	c = _request(dmac, size, cfg, &hit);
+	if (!c)
+		return 0;
+	c->callback = callback;
+	c->arg = arg;
+	c->autofree = autofree;
+
+	cache_clean_range(src, size);
+	cache_inv_range(dst, size);
+
+	if (hit) {
+		_patch_addr(c, src, dst);
 	} else {
-		lcnt1 = *bursts;
-		lcnt0 = 0;
-		cyc = 1;
-	}
+		if (pl330_copy_prog(1, 0, src, dst, size, ns) + pl330_tail(1, 0, 0) > DMA_MC_SIZE) {
+			c->prog_cfg = 0;
+			dma_release(c);
+			return 0;
+		}
 
-	szlp = _emit_LP(1, buf, 0, 0);
-	szbrst = _bursts(1, buf, pxs, 1);
+		PL330_DBGMC_START(off);
 
-	lpend.cond = ALWAYS;
-	lpend.forever = false;
-	lpend.loop = 0;
-	lpend.bjump = 0;
-	szlpend = _emit_LPEND(1, buf, &lpend);
+		off += pl330_copy_prog(0, &c->mc[off], src, dst, size, ns);
+		off += pl330_tail(0, &c->mc[off], c->id);
 
-	if (lcnt0) {
-		szlp *= 2;
-		szlpend *= 2;
+		c->sar = 0;		// _copy_prog starts with DMAMOV SAR, DMAMOV DAR
+		c->dar = SZ_DMAMOV;
 	}
 
-	/*
-	 * Max bursts that we can unroll due to limit on the
-	 * size of backward jump that can be encoded in DMALPEND
-	 * which is 8-bits and hence 255
-	 */
-	//cycmax = (255 - (szlp + szlpend)) / szbrst;
-	// DMALP: 2bytes    DMALPEND: 2bytes
-	// szbrst = DMALD: 1byte + DMAST: 1byte
-	cycmax = (255 - (2*2 + 2*2)) / 2;
+	dma_start(c);
 
-	cyc = (cycmax < cyc) ? cycmax : cyc;
+	return c;
+}
 
-	off = 0;
+struct dma_chan * dma_copy_async(int src, int dst, int size,
+		void (*callback)(void *), void * arg)
+{
+	if (size <= 0)
+		return 0;
 
-	if (lcnt0) {
-		off += _emit_LP(dry_run, &buf[off], 0, lcnt0);
-		ljmp0 = off;
-	}
+	return _copy_start(DMAC_MEM, src, dst, size, callback, arg, callback != 0);
+}
 
-	off += _emit_LP(dry_run, &buf[off], 1, lcnt1);
-	ljmp1 = off;
+int dma_copy(int src, int dst, int size)
+{
+	struct dma_chan * c;
+	u32 start, cycles;
 
-	off += _bursts(dry_run, &buf[off], pxs, cyc);
+	if (size <= 0)
+		return 0;
 
-	lpend.cond = ALWAYS;
-	lpend.forever = false;
-	lpend.loop = 1;
-	lpend.bjump = off - ljmp1;
-	off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	start = pmu_get_cycles();
+	c = dma_copy_async(src, dst, size, 0, 0);
+	if (!c || dma_wait(c) < 0)
+		return -1;
+	cycles = pmu_get_cycles() - start;
 
-	if (lcnt0) {
-		lpend.cond = ALWAYS;
-		lpend.forever = false;
-		lpend.loop = 0;
-		lpend.bjump = off - ljmp0;
-		off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	// bytes per us = MB/s, CCNT runs at 1GHz
+	cycles /= 1000;
+	return udiv(size, cycles ? cycles : 1);
+}
+
+/* starts the copy and returns, the channel frees itself at the end */
+int dma_mem_transfer(int src, int dst, int size)
+{
+	if (size <= 0)
+		return 0;
+
+	return _copy_start(DMAC_MEM, src, dst, size, 0, 0, 1) ? 0 : -1;
+}
+
+/*
+ * One thread does not keep the memory bus busy, so a big copy is cut into
+ * dma_copy_split parts on 128-byte (burst) steps: parts 0-3 on DMA_MEM
+ * threads, 4-7 on DMA_peri ones. All parts are started before the first
+ * is waited for; a part that finds no free thread is done by the CPU.
+ */
+#define DMA_SPLIT_MAX	8
+#define DMA_SPLIT_MIN	(64 * 1024)	// below that the split costs more than it gives
+
+int dma_copy_split = 1;
+
+int dma_copy_parallel(int src, int dst, int size)
+{
+	struct dma_chan * c[DMA_SPLIT_MAX];
+	int n = dma_copy_split, part, off, len, i, ret = 0;
+
+	if (size <= 0)
+		return 0;
+	if (size < DMA_SPLIT_MIN || n < 1)
+		n = 1;
+	if (n > DMA_SPLIT_MAX)
+		n = DMA_SPLIT_MAX;
+
+	part = udiv(size, n) & ~127;
+	for (i = 0, off = 0; i < n; i++, off += part) {
+		len = i == n - 1 ? size - off : part;
+		c[i] = _copy_start(i < DMA_CHANNELS / 2 ? DMAC_MEM : DMAC_PERI,
+				src + off, dst + off, len, 0, 0, 0);
+		if (!c[i])
+			memcpy((void *)(dst + off), (void *)(src + off), len);
 	}
 
-	*bursts = lcnt1 * cyc;
-	if (lcnt0)
-		*bursts *= lcnt0;
+	for (i = 0; i < n; i++)
+		if (c[i] && dma_wait(c[i]) < 0)
+			ret = -1;
 
-	return off;
+	return ret;
 }
 
-static inline int _setup_loops(unsigned dry_run, u8 buf[],
-		const struct _xfer_spec *pxs)
+/*
+ * Times dma_copy_parallel() split 1, 2, 4 and 8 ways, best of 3 after a run
+ * that builds the programs, and keeps the fastest in dma_copy_split. A wider
+ * split has to be 1/16 faster to be taken. mbps[] gets MB/s per split.
+ */
+int dma_copy_calibrate(int src, int dst, int size, int mbps[4])
 {
-	//struct pl330_xfer *x = pxs->x;
-	//u32 ccr = pxs->ccr;
-	unsigned long c, bursts = pxs->size;		// BYTE_TO_BURST(x->bytes, ccr);
-	int off = 0;
-
-	while (bursts) {
-		c = bursts;
-		off += _loop(dry_run, &buf[off], &c, pxs);		
-		bursts -= c;
+	u32 t, min, best = ~0;
+	int n, i, k, split = 1;
+
+	for (k = 0, n = 1; n <= DMA_SPLIT_MAX; k++, n <<= 1) {
+		dma_copy_split = n;
+		if (dma_copy_parallel(src, dst, size) < 0) {
+			dma_copy_split = 1;
+			return -1;
+		}
+
+		min = ~0;
+		for (i = 0; i < 3; i++) {
+			t = pmu_get_cycles();
+			dma_copy_parallel(src, dst, size);
+			t = pmu_get_cycles() - t;
+			if (t < min)
+				min = t;
+		}
+
+		if (mbps)
+			mbps[k] = udiv(size, min / 1000 ? min / 1000 : 1);
+		if (min + (min >> 4) < best) {
+			best = min;
+			split = n;
+		}
 	}
 
-	return off;
+	dma_copy_split = split;
+	return split;
 }
 
-int dma_mem_transfer(int src, int dst, int size)
+struct dma_chan * dma_copy_2d_async(int src, int src_stride, int dst, int dst_stride,
+		int width, int height, void (*callback)(void *), void * arg)
 {
-	u32 ccr = 0;
+	struct dma_chan * c;
 	int off;
-	//int ljmp;
-	unsigned dry_run;
-	//struct _arg_LPEND lpend;
-	struct _arg_GO go;
-	u8 insn[6] = {0, 0, 0, 0, 0, 0};
-	int ev = 0;
-	//u8 buf[256];
-	u8 buf[60000];
-	//int cyc, i;
-	//unsigned lcnt0, lcnt1, ljmp0, ljmp1;
-	//unsigned lcnt1, ljmp1;	
-	struct _xfer_spec xs;	
 
-	ccr |= CC_SRCINC;
-	ccr |= CC_DSTINC;
+	if (width <= 0 || height <= 0 || src_stride < width || dst_stride < width)
+		return 0;
+	if (src_stride - width > 0xffff || dst_stride - width > 0xffff)
+		return 0;	// DMAADDH takes 16 bits
 
-	ccr |= (0 << CC_SRCBRSTSIZE_SHFT);
-	ccr |= (0 << CC_DSTBRSTSIZE_SHFT);
-	
-	ccr |= (((1 - 1) & 0xf) << CC_SRCBRSTLEN_SHFT);
-	ccr |= (((1 - 1) & 0xf) << CC_DSTBRSTLEN_SHFT);
-
-	ccr |= (1 << CC_SRCCCTRL_SHFT);
-	ccr |= (1 << CC_DSTCCTRL_SHFT);
+	off = pl330_rect_prog(1, 0, src, src_stride, dst, dst_stride, width, height);
+	if (off < 0 || off + pl330_tail(1, 0, 0) > DMA_MC_SIZE)
+		return 0;
 
-	off = 0;
-	dry_run = 0;
+	c = dma_request(DMAC_MEM);
+	if (!c)
+		return 0;
+	c->callback = callback;
+	c->arg = arg;
+	c->autofree = callback != 0;
 
-	PL330_DBGMC_START(off);
+	// flush, not inv: the box also holds the gaps between the rows, which
+	// the DMA leaves alone and which may be dirty in the cache
+	cache_clean_range(src, src_stride * (height - 1) + width);
+	cache_flush_range(dst, dst_stride * (height - 1) + width);
 
-	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
+	off = pl330_rect_prog(0, c->mc, src, src_stride, dst, dst_stride, width, height);
+	off += pl330_tail(0, &c->mc[off], c->id);
 
-	off += _emit_MOV(dry_run, &buf[off], SAR, src);
-	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
-	/* Setup Loop(s) */
-	xs.size = size;
-	off += _setup_loops(dry_run, &buf[off], &xs);
+	dma_start(c);
 
-	off +=_emit_SEV(dry_run, &buf[off], ev);
-	off += _emit_END(dry_run, &buf[off]);
+	return c;
+}
 
-	go.chan = 0;
-	go.addr = (int)buf;
-	go.ns = 0;	// 1 is non-secure mode, and DMA_mem could be in non-secure mode
-	_emit_GO(0, insn, &go);
+int dma_copy_2d(int src, int src_stride, int dst, int dst_stride, int width, int height)
+{
+	struct dma_chan * c;
 
-	_execute_DBGINSN(DMA_MEM, insn, true);
+	c = dma_copy_2d_async(src, src_stride, dst, dst_stride, width, height, 0, 0);
+	if (!c)
+		return -1;
 
-	return 0;
+	return dma_wait(c);
 }
 
-#if 0
-int dma_mem_transfer(int src, int dst, int size)
+struct dma_chan * dma_copy_sg_async(const struct dma_sg * sg, int n,
+		void (*callback)(void *), void * arg)
 {
-	u32 ccr = 0;
-	int off;
-	//int ljmp;
-	unsigned dry_run;
-	struct _arg_LPEND lpend;
-	struct _arg_GO go;
-	u8 insn[6] = {0, 0, 0, 0, 0, 0};
-	int ev = 0;
-	//u8 buf[256];
-	u8 buf[60000];
-	int cyc, i;
-	//unsigned lcnt0, lcnt1, ljmp0, ljmp1;
-	unsigned lcnt1, ljmp1;
+	struct dma_chan * c;
+	int off, i;
+
+	if (pl330_sg_prog(1, 0, sg, n) + pl330_tail(1, 0, 0) > DMA_MC_SIZE)
+		return 0;
+
+	c = dma_request(DMAC_MEM);
+	if (!c)
+		return 0;
+	c->callback = callback;
+	c->arg = arg;
+	c->autofree = callback != 0;
+
+	for (i = 0; i < n; i++) {
+		cache_clean_range(sg[i].src, sg[i].size);
+		cache_inv_range(sg[i].dst, sg[i].size);
+	}
 
-	ccr |= CC_SRCINC;
-	ccr |= CC_DSTINC;
+	off = pl330_sg_prog(0, c->mc, sg, n);
+	off += pl330_tail(0, &c->mc[off], c->id);
 
-	//if (rqc->nonsecure)
-	//	ccr |= CC_SRCNS | CC_DSTNS;		// DMA_peri must be non-secure
+	dma_start(c);
 
-	ccr |= (0 << CC_SRCBRSTSIZE_SHFT);
-	ccr |= (0 << CC_DSTBRSTSIZE_SHFT);
-	
-	ccr |= (((1 - 1) & 0xf) << CC_SRCBRSTLEN_SHFT);
-	ccr |= (((1 - 1) & 0xf) << CC_DSTBRSTLEN_SHFT);
+	return c;
+}
 
-	ccr |= (1 << CC_SRCCCTRL_SHFT);
-	ccr |= (1 << CC_DSTCCTRL_SHFT);
+int dma_copy_sg(const struct dma_sg * sg, int n)
+{
+	struct dma_chan * c;
 
-	off = 0;
-	dry_run = 0;
+	c = dma_copy_sg_async(sg, n, 0, 0);
+	if (!c)
+		return -1;
 
-	PL330_DBGMC_START(off);
+	return dma_wait(c);
+}
 
-	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
+/*
+ * Memory -> peripheral ring on DMA_PERI (pl330_ring_prog), the callback
+ * refills the period that just went out while the DMAC plays the others.
+ * dma_stop() ends it.
+ */
+struct dma_chan * dma_peri_ring(int ring, int period, int periods, int dst, int peri,
+		void (*callback)(void *), void * arg)
+{
+	struct dma_chan * c;
 
-	off += _emit_MOV(dry_run, &buf[off], SAR, src);
-	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
-	
-#if 0
-	off += _emit_LP(dry_run, &buf[off], 0,  size);
-	ljmp = off;
+	if (pl330_ring_prog(1, 0, ring, period, periods, dst, peri, 0) < 0)
+		return 0;
 
-	off += _emit_LD(dry_run, &buf[off], ALWAYS);
-	off += _emit_ST(dry_run, &buf[off], ALWAYS);
+	c = dma_request(DMAC_PERI);
+	if (!c)
+		return 0;
+	c->callback = callback;
+	c->arg = arg;
+	c->cyclic = 1;
 
-	lpend.cond = SINGLE;
-	lpend.forever = 0;
-	lpend.loop = 0;		// lc0
-	lpend.bjump = off - ljmp;
-	off += _emit_LPEND(dry_run, &buf[off], &lpend);
-#endif	
+	// the callback cleans each period it refills
+	cache_clean_range(ring, period * periods);
 
-#if 1
-//	off += _emit_LP(dry_run, &buf[off], 0,  0);
-//	ljmp0 = off;
-	
-	lcnt1 = 256;
-	cyc = 1;
+	pl330_ring_prog(0, c->mc, ring, period, periods, dst, peri, c->id);
 
-//	for (i = 0; i < *bursts/256; i++) {
-	for (i = 0; i < size/256; i++) {
-		off += _emit_LP(dry_run, &buf[off], 1, lcnt1);
-		ljmp1 = off;
-
-	//	off += _bursts(dry_run, &buf[off], pxs, cyc);
-		off += _bursts(dry_run, &buf[off], 0, cyc);
+	dma_start(c);
 
-		lpend.cond = ALWAYS;
-		lpend.forever = false;
-		lpend.loop = 1;
-		lpend.bjump = off - ljmp1;
-		off += _emit_LPEND(dry_run, &buf[off], &lpend);
-	}
-	off +=_emit_SEV(dry_run, &buf[off], ev);
+	return c;
+}
 
-	lpend.cond = ALWAYS;
-	lpend.forever = false;
-	lpend.loop = 0;
-//	lpend.bjump = off - ljmp0;
-//	off += _emit_LPEND(dry_run, &buf[off], &lpend);
-#endif
+/*
+ * The source of a fill is an 8-byte pattern per DMA_MEM thread, read at a
+ * fixed address for every beat. Its key is the size, the low 7 bits of
+ * dst and whether the pattern is 0 (DMASTZ, nothing is read).
+ */
+static u32 dma_fill_pat[DMA_CHANNELS][2] __attribute__((aligned(8)));
 
-	//printbuf(buf, off);
+static struct dma_chan * _fill_start(int dst, u32 value, int size,
+		void (*callback)(void *), void * arg, int autofree)
+{
+	int zero = value == 0;
+	u32 cfg = DMA_PROG_FILL | (zero << 7) | (dst & 0x7f);
+	struct dma_chan * c;
+	u32 pat;
+	int off = 0, hit;
+
+	c = _request(DMAC_MEM, size, cfg, &hit);
+	if (!c)
+		return 0;
+	c->callback = callback;
+	c->arg = arg;
+	c->autofree = autofree;
+
+	pat = (u32)dma_fill_pat[c->id];
+	dma_fill_pat[c->id][0] = value;
+	dma_fill_pat[c->id][1] = value;
+	cache_clean_range(pat, 8);
+	cache_inv_range(dst, size);
+
+	if (hit) {
+		_patch_addr(c, pat, dst);
+	} else {
+		if (pl330_fill_prog(1, 0, pat, dst, size, zero) + pl330_tail(1, 0, 0) > DMA_MC_SIZE) {
+			c->prog_cfg = 0;
+			dma_release(c);
+			return 0;
+		}
 
-	off +=_emit_SEV(dry_run, &buf[off], ev);
-	off += _emit_END(dry_run, &buf[off]);
+		off += pl330_fill_prog(0, &c->mc[off], pat, dst, size, zero);
+		off += pl330_tail(0, &c->mc[off], c->id);
 
-	go.chan = 0;
-	go.addr = (int)buf;
-	go.ns = 0;	// 1 is non-secure mode, and DMA_mem could be in non-secure mode
-	_emit_GO(0, insn, &go);
+		c->sar = 0;		// _fill_prog starts with DMAMOV SAR, DMAMOV DAR
+		c->dar = SZ_DMAMOV;
+	}
 
-	_execute_DBGINSN(DMA_MEM, insn, true);
+	dma_start(c);
 
-	return 0;
+	return c;
 }
-#endif
 
-int dma_peri_transfer(int src, int dst, int peri, int size)
+struct dma_chan * dma_fill_async(int dst, unsigned int value, int size,
+		void (*callback)(void *), void * arg)
 {
-	u32 ccr = 0;
-	int off;
-	int ljmp;
-	unsigned dry_run;
-	struct _arg_LPEND lpend;
-	struct _arg_GO go;
-	u8 insn[6] = {0, 0, 0, 0, 0, 0};
-	int ev = 0;
-	u8 buf[256];
-
-	ccr |= CC_SRCINC;
-//	ccr |= CC_DSTINC;
-
-	//if (rqc->nonsecure)
-		ccr |= CC_SRCNS | CC_DSTNS;		// DMA_peri must be non-secure
+	if (size <= 0)
+		return 0;
 
-	ccr |= (0 << CC_SRCBRSTSIZE_SHFT);
-	ccr |= (0 << CC_DSTBRSTSIZE_SHFT);
-	
-	ccr |= (((1 - 1) & 0xf) << CC_SRCBRSTLEN_SHFT);
-	ccr |= (((1 - 1) & 0xf) << CC_DSTBRSTLEN_SHFT);
+	return _fill_start(dst, value, size, callback, arg, callback != 0);
+}
 
-	ccr |= (1 << CC_SRCCCTRL_SHFT);
-	ccr |= (1 << CC_DSTCCTRL_SHFT);
+int dma_fill(int dst, unsigned int value, int size)
+{
+	struct dma_chan * c;
 
-	off = 0;
-	dry_run = 0;
+	if (size <= 0)
+		return 0;
 
-	PL330_DBGMC_START(off);
+	c = dma_fill_async(dst, value, size, 0, 0);
+	if (!c || dma_wait(c) < 0)
+		return -1;
 
-	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
-	off += _emit_FLUSHP(dry_run, &buf[off], peri);
+	return 0;
+}
 
-	off += _emit_MOV(dry_run, &buf[off], SAR, src);
-	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+int dma_memset(int dst, int ch, int size)
+{
+	return dma_fill(dst, (ch & 0xff) * 0x01010101, size);
+}
 
-	off += _emit_LP(dry_run, &buf[off], 0,  size);
-	ljmp = off;
+/* starts size (<= 256) single transfers to peri and returns, the channel frees itself */
+int dma_peri_transfer(int src, int dst, int peri, int size)
+{
+	struct dma_chan * c;
+	int hit;
 
-	off += _emit_WFP(dry_run, &buf[off], SINGLE, peri);
-	off += _emit_LD(dry_run, &buf[off], ALWAYS);
-	off += _emit_STP(dry_run, &buf[off], SINGLE, peri);	// UART0_TX = 1
-	off += _emit_FLUSHP(dry_run, &buf[off], peri);
-	
-	lpend.cond = SINGLE;
-	lpend.forever = 0;
-	lpend.loop = 0;		// lc0
-	lpend.bjump = off - ljmp;
-	off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	c = _request(DMAC_PERI, size, DMA_PROG_PERI | peri, &hit);
+	if (!c)
+		return -1;
+	c->autofree = 1;
 
-	off +=_emit_SEV(dry_run, &buf[off], ev);
-	off += _emit_END(dry_run, &buf[off]);
+	cache_clean_range(src, size);
 
-	go.chan = 0;
-	go.addr = (int)buf;
-	go.ns = 1;	// 1 is non-secure mode, and DMA_peri must be non-secure
-	_emit_GO(0, insn, &go);
+	if (hit)
+		_patch_addr(c, src, dst);
+	else
+		pl330_peri_prog(0, c->mc, src, dst, peri, size, c->id, &c->sar, &c->dar);
 
-	_execute_DBGINSN(DMA_PERI, insn, true);
+	dma_start(c);
 
 	return 0;
 }
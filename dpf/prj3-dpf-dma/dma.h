@@ -1,4 +1,94 @@
 
+#define DMAC_MEM	0	// DMA_MEM 0xFA200000, memory to memory
+#define DMAC_PERI	1	// DMA_PERI (PDMA0) 0xE0900000, memory <-> peripheral
+#define DMA_CHANNELS	8	// threads of one PL330
+#define DMA_MC_SIZE	512	// microcode buffer of one thread
+
+struct dma_chan {
+	int dmac;			// DMAC_MEM or DMAC_PERI
+	int id;				// thread, also the DMASEV event / irq bit
+	volatile int busy;		// handed out by dma_request()
+	volatile int done;		// the program reached its DMASEV or faulted
+	volatile int fault;		// FTC of the thread if it faulted
+	int autofree;			// released on completion, nobody waits
+	int cyclic;			// runs until dma_stop(), callback per event
+	void (*callback)(void * arg);	// on completion, in irq context
+	void * arg;
+	unsigned int prog_size;		// key of the program in mc, 0 cfg: none
+	unsigned int prog_cfg;
+	int sar, dar;			// offsets of its DMAMOV SAR/DAR
+	unsigned char mc[DMA_MC_SIZE];	// the program, read by the DMAC while it runs
+};
+
+// programs reused / generated by dma_copy, dma_mem_transfer and dma_peri_transfer
+extern int dma_cache_hits, dma_cache_misses;
+
+// sets INTEN and registers the MDMA/PDMA0 irqs (VIC0 18/19), irq_init() first
+void dma_init(void);
+
+// a free thread of the DMAC or 0, dma_release() gives it back;
+// its mc is the caller's to fill
+struct dma_chan * dma_request(int dmac);
+void dma_release(struct dma_chan * chan);
+
+// runs chan->mc, which must end with DMASEV chan->id
+void dma_start(struct dma_chan * chan);
+
+// waits for a channel started without callback and releases it, -1 on fault
+int dma_wait(struct dma_chan * chan);
+
+// kills a running channel and releases it, also from its callback
+void dma_stop(struct dma_chan * chan);
+
+// completes finished channels of DMAC (int)ctx, registered with vic.c
+void dma_irq_handler(void * ctx);
+
+// starts a burst copy on DMA_MEM and returns the channel (0 if none is free).
+// With a callback the channel is released after it runs, do not dma_wait() it;
+// without one dma_wait() it.
+struct dma_chan * dma_copy_async(int src, int dst, int size,
+		void (*callback)(void * arg), void * arg);
+
+// copies a width x height window between buffers with the given strides
+// (bytes per line, at most width + 65535) with one program, 0 / -1
+struct dma_chan * dma_copy_2d_async(int src, int src_stride, int dst, int dst_stride,
+		int width, int height, void (*callback)(void * arg), void * arg);
+int dma_copy_2d(int src, int src_stride, int dst, int dst_stride, int width, int height);
+
+// scatter-gather: all entries of the list in one program, 0 / -1
+struct dma_sg {
+	int src;
+	int dst;
+	int size;
+};
+
+struct dma_chan * dma_copy_sg_async(const struct dma_sg * sg, int n,
+		void (*callback)(void * arg), void * arg);
+int dma_copy_sg(const struct dma_sg * sg, int n);
+
+// starts a copy and returns, the channel releases itself
 int dma_mem_transfer(int src, int dst, int size);
 
+// burst copy on DMA_MEM, waits for the end and returns MB/s (-1 on fault)
+int dma_copy(int src, int dst, int size);
+
+// copy cut over dma_copy_split threads (1 2 4 8, above 4 also DMA_PERI),
+// waits for all of them, 0 / -1; dma_copy_calibrate() times each split on
+// the given copy, keeps the fastest and returns it
+extern int dma_copy_split;
+int dma_copy_parallel(int src, int dst, int size);
+int dma_copy_calibrate(int src, int dst, int size, int mbps[4]);
+
 int dma_peri_transfer(int src, int dst, int peri, int size);
+
+// fill size bytes at dst with the 32-bit value (DMASTZ for 0), dst and size
+// in words unless all bytes of value are equal; dma_fill waits, 0 / -1
+struct dma_chan * dma_fill_async(int dst, unsigned int value, int size,
+		void (*callback)(void * arg), void * arg);
+int dma_fill(int dst, unsigned int value, int size);
+int dma_memset(int dst, int ch, int size);
+
+// endless memory -> peri ring on DMA_PERI, 16-bit beats; callback in irq
+// context after every period (period bytes, 512 multiple above 512 bytes)
+struct dma_chan * dma_peri_ring(int ring, int period, int periods, int dst, int peri,
+		void (*callback)(void * arg), void * arg);
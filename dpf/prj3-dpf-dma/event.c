@@ -0,0 +1,105 @@
+
+#include "stdio.h"
+#include "ticks.h"
+#include "event.h"
+
+// the other side reads what is written before the index moves; one core,
+// so only the compiler may reorder them
+#define barrier()	__asm__ __volatile__("" : : : "memory")
+
+void event_queue_init(struct event_queue * q)
+{
+	q->head = 0;
+	q->tail = 0;
+	q->dropped = 0;
+}
+
+// head and tail run free, head - tail is the fill level even across a wrap
+int event_post(struct event_queue * q, int type, unsigned int arg)
+{
+	unsigned int head = q->head;
+	struct event * e;
+
+	if (head - q->tail >= EVENT_QUEUE_SIZE) {
+		q->dropped++;
+		return -1;
+	}
+
+	e = &q->ev[head & (EVENT_QUEUE_SIZE - 1)];
+	e->type = type;
+	e->arg = arg;
+	e->time = (unsigned int)get_ticks();
+	barrier();
+	q->head = head + 1;
+
+	return 0;
+}
+
+int event_get(struct event_queue * q, struct event * e)
+{
+	unsigned int tail = q->tail;
+
+	if (tail == q->head)
+		return 0;
+	barrier();
+
+	*e = q->ev[tail & (EVENT_QUEUE_SIZE - 1)];
+	barrier();
+	q->tail = tail + 1;
+
+	return 1;
+}
+
+static struct work * works;
+
+void work_init(struct work * w, work_fn_t fn, void * ctx)
+{
+	w->fn = fn;
+	w->ctx = ctx;
+	w->pending = 0;
+	w->count = 0;
+	w->max_delay = 0;
+	w->next = works;
+	works = w;
+}
+
+void work_schedule(struct work * w)
+{
+	// a second schedule before the run only moves the time forward
+	w->scheduled = (unsigned int)get_ticks();
+	barrier();
+	w->pending = 1;
+}
+
+int work_run(void)
+{
+	struct work * w;
+	unsigned int delay;
+	int n = 0;
+
+	for (w = works; w; w = w->next) {
+		if (!w->pending)
+			continue;
+
+		// cleared first: a schedule while fn runs runs it again
+		w->pending = 0;
+		barrier();
+		delay = (unsigned int)get_ticks() - w->scheduled;
+		if (delay > w->max_delay)
+			w->max_delay = delay;
+		w->count++;
+
+		w->fn(w->ctx);
+		n++;
+	}
+
+	return n;
+}
+
+void work_stats_show(void)
+{
+	struct work * w;
+
+	for (w = works; w; w = w->next)
+		printf("work %p: %8u, delay max %u us\n", w->fn, w->count, w->max_delay);
+}
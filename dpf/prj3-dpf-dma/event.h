@@ -0,0 +1,58 @@
+
+// Work out of interrupt context. A handler only records what happened and
+// returns; the main loop calls work_run() and does the rest with irqs on.
+//
+// event_queue: a ring from one producer (one irq handler) to one consumer
+// (the main loop). Each side writes only its own index, so neither locks
+// nor masks irqs. One core, so a compiler barrier orders the slot before
+// the index; give every producer its own queue, a nested irq of another
+// source must not post into it.
+//
+// work: a function the main loop runs once after work_schedule(), which
+// any handler may call; scheduling twice before it runs runs it once.
+
+#define EVENT_QUEUE_SIZE	32		// a power of 2
+
+struct event {
+	int type;
+	unsigned int arg;
+	unsigned int time;			// get_ticks() at event_post(), us
+};
+
+struct event_queue {
+	volatile unsigned int head;		// written by the producer only
+	volatile unsigned int tail;		// written by the consumer only
+	unsigned int dropped;			// posts that found it full
+	struct event ev[EVENT_QUEUE_SIZE];
+};
+
+void event_queue_init(struct event_queue * q);
+
+// producer: 0, or -1 and dropped++ when it is full
+int event_post(struct event_queue * q, int type, unsigned int arg);
+
+// consumer: 1 and the oldest event in e, or 0 when it is empty
+int event_get(struct event_queue * q, struct event * e);
+
+typedef void (*work_fn_t)(void * ctx);
+
+struct work {
+	work_fn_t fn;
+	void * ctx;
+	volatile int pending;
+	unsigned int count;			// runs
+	unsigned int max_delay;			// us from work_schedule() to the run
+	unsigned int scheduled;
+	struct work * next;
+};
+
+// from the main loop, before anything may schedule w
+void work_init(struct work * w, work_fn_t fn, void * ctx);
+
+// any context, lock-free: a store to w
+void work_schedule(struct work * w);
+
+// main loop: runs every pending work, returns how many ran
+int work_run(void);
+
+void work_stats_show(void);
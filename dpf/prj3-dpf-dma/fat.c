@@ -28,17 +28,16 @@
 #include "stdio.h"
 #include "lib.h"
 #include "sdhc.h"
+#include "trace.h"
 
 //#define DEBUG
 #undef DEBUG
 
+// printf when debugging by hand, otherwise a binary trace event
 #ifdef DEBUG
 #define	debug		printf
 #else
-static int debug(const char * fmt, ...)
-{
-	return 0;
-}
+#define	debug		TRACE
 #endif
 
 #define TOLOWER(c)	if((c) >= 'A' && (c) <= 'Z'){(c)+=('a' - 'A');}
@@ -1,13 +1,99 @@
 
+@ IRQ entry of every VIC vector (see vic.c). sp_irq is set once in start.s
+@ and only holds the return address and SPSR until they are moved onto the
+@ interrupted SVC stack; the handlers run there, so with irq_nesting they can
+@ be interrupted without losing lr_irq.
+@
+@ Frame on the SVC stack, low to high: r0-r3, r12, lr, spsr, pc. A thread
+@ that is switched out (thread.c) has r4-r11 below it, whether an irq or
+@ thread_switch() took it off the CPU, and below those its VFP / NEON state:
+@ d0-d31, FPSCR, FPEXC. The handlers are not built for VFP, so only a
+@ switch saves it.
+
+.fpu neon
+
 .global asm_IRQ_handler
+.global thread_switch
+
 asm_IRQ_handler:
-	@ set sp_irq = iRAM top (sp--)
-	ldr sp, =0xD0034000
-	
 	@ lr = lr - 4
 	sub r14, r14, #4
-	STMFD r13!, {r1-r12, r14}
-	
+	stmfd r13!, {r14}
+	mrs r14, spsr
+	stmfd r13!, {r14}
+
+	@ SVC, irqs still off: the caller-saved registers of whoever was interrupted
+	msr cpsr_c, #0xD3
+	sub r13, r13, #8
+	stmfd r13!, {r0-r3, r12, r14}
+
+	@ spsr and return address from the irq stack into the frame
+	msr cpsr_c, #0xD2
+	ldmfd r13!, {r0, r1}
+	msr cpsr_c, #0xD3
+	add r2, r13, #24
+	stmia r2, {r0, r1}
+
+	ldr r0, =irq_depth
+	ldr r1, [r0]
+	add r1, r1, #1
+	str r1, [r0]
+
+	mov r0, r13
 	bl C_IRQ_handler
-	
-	LDMFD r13!, {r1-r12, pc}^
+
+	ldr r0, =irq_depth
+	ldr r1, [r0]
+	subs r1, r1, #1
+	str r1, [r0]
+	bne irq_return
+
+	@ leaving the outermost level: a handler may have woken a thread that
+	@ comes before the interrupted one
+	ldr r0, =need_resched
+	ldr r0, [r0]
+	cmp r0, #0
+	beq irq_return
+	stmfd r13!, {r4-r11}
+	b _switch
+
+@ void thread_switch(void), irqs off: the same frame, returning to the
+@ caller with its cpsr
+thread_switch:
+	sub r13, r13, #8
+	stmfd r13!, {r0-r3, r12, r14}
+	mrs r0, cpsr
+	str r0, [r13, #24]
+	str r14, [r13, #28]
+	stmfd r13!, {r4-r11}
+
+_switch:
+	@ FPEXC.EN on for the vstm, the thread's own FPEXC goes back last
+	vmrs r1, fpexc
+	orr r2, r1, #0x40000000
+	vmsr fpexc, r2
+	vmrs r0, fpscr
+	stmfd r13!, {r0, r1}
+	vstmdb r13!, {d16-d31}
+	vstmdb r13!, {d0-d15}
+
+	mov r0, r13
+	bl _thread_schedule		@ r0 = sp of the thread to run
+	mov r13, r0
+
+	vmrs r1, fpexc
+	orr r1, r1, #0x40000000
+	vmsr fpexc, r1
+	vldmia r13!, {d0-d15}
+	vldmia r13!, {d16-d31}
+	ldmfd r13!, {r0, r1}
+	vmsr fpscr, r0
+	vmsr fpexc, r1
+	ldmfd r13!, {r4-r11}
+
+irq_return:
+	ldr r0, [r13, #24]
+	msr spsr_cxsf, r0
+	ldmfd r13!, {r0-r3, r12, r14}
+	add r13, r13, #4
+	ldmfd r13!, {pc}^
@@ -1,3 +1,6 @@
+#include "dma.h"
+#include "mmu.h"
+#include "neon.h"
 
 #define GPF0CON		(*(volatile unsigned int *)0xE0200120)
 #define GPF1CON		(*(volatile unsigned int *)0xE0200140)
@@ -138,6 +141,10 @@ void lcd_draw_pixel(int row, int col, int color)
 void lcd_clear_screen(int color)
 {
 	int i, j;
+
+	// one DMA fill of the frame, pixel by pixel only if that fails
+	if (dma_fill(FB_ADDR, color, ROW * COL * 4) == 0)
+		return;
 		
 	for (i = 0; i < ROW; i++)
 		for (j = 0; j < COL; j++)
@@ -209,26 +216,21 @@ void lcd_draw_bmp(int bmp_file_addr)
 
 void lcd_draw_bmp_v(int bmp_file_addr, int fb_addr)
 {
-	int i, j;
-	char * p = (char *)bmp_file_addr;
-	int blue, green, red;
-	int color;
+	int i;
+	unsigned char * p = (unsigned char *)bmp_file_addr;
+	void (*bgr2xrgb)(unsigned int *, const unsigned char *, int);
+
+	bgr2xrgb = neon_present() ? neon_bgr2xrgb : c_bgr2xrgb;
 
 	// read bmp file
-	// bmp file header is 54 bytes
+	// bmp file header is 54 bytes, rows are stored bottom up
 	p += 54;
 	
-	for (i = 0; i < 272; i++)
-		for (j = 0; j < 480; j++)
-		{
-			blue = *p++;
-			green = *p++;
-			red = *p++;
-		
-			color = red << 16 | green << 8 | blue << 0;
-			
-			lcd_draw_pixel_v(271-i, j, color, fb_addr);
-		}
+	for (i = 0; i < ROW; i++)
+		bgr2xrgb((unsigned int *)fb_addr + (ROW - 1 - i) * COL, p + i * COL * 3, COL);
+
+	// the frame goes to the screen by DMA or the LCD controller, both read SDRAM
+	cache_clean_range(fb_addr, ROW * COL * 4);
 
 	return;
 }		
@@ -2,21 +2,17 @@
 #include "uart.h"
 #include "stdio.h"
 #include "lib.h"
+#include "ticks.h"
 
+// the time base counts us, shorter waits round up to one
 void ndelay(int n)
 {
-	int i;
-	
-	for (i = 0; i < n; i++)
-		;
+	udelay((n + 999) / 1000);
 }
 
 void delay(void)
 {
-	int i;
-	
-	for (i = 0; i < 0x1000000; i++)
-		;
+	mdelay(100);
 }
 
 int atoi(char * buf)
@@ -50,8 +46,36 @@ int atoi(char * buf)
 	return value;
 }
 
+// a word has a 0 byte if (w - 0x01010101) & ~w & 0x80808080
+#define HAS_ZERO(w)	(((w) - 0x01010101) & ~(w) & 0x80808080)
+
+// a word at a time while both strings sit at the same offset in a word
 int strcmp(const char * s1, const char * s2)
 {
+	const unsigned int * w1, * w2;
+
+	if ((((int)s1 ^ (int)s2) & 3) == 0)
+	{
+		while (((int)s1 & 3) && *s1 && *s1 == *s2)
+		{
+			s1++;
+			s2++;
+		}
+
+		if (((int)s1 & 3) == 0)
+		{
+			w1 = (const unsigned int *)s1;
+			w2 = (const unsigned int *)s2;
+			while (*w1 == *w2 && !HAS_ZERO(*w1))
+			{
+				w1++;
+				w2++;
+			}
+			s1 = (const char *)w1;
+			s2 = (const char *)w2;
+		}
+	}
+
 	while (*s1 == *s2)
 	{
 		if (*s1 == '\0')
@@ -90,7 +114,21 @@ char* strcpy(char * dst, const char * src)
 int strlen(char * s)
 {
 	char * p = s;
+	unsigned int * w;
 
+	while ((int)p & 3)
+	{
+		if (*p == '\0')
+			return p - s;
+		p++;
+	}
+
+	// aligned words never cross into a page the string does not touch
+	w = (unsigned int *)p;
+	while (!HAS_ZERO(*w))
+		w++;
+
+	p = (char *)w;
 	while(*p)
 		p++;
 
@@ -111,17 +149,35 @@ char * strncpy ( char * dst, const char * src, int count )
 	return(start);
 }
 
-void *memcpy(void *dest, const void *src, int count)
+// memcpy, memmove and memset are in string.s
+
+// n / d without a divide instruction or libgcc, shift and subtract
+unsigned int udiv(unsigned int n, unsigned int d)
 {
-	// assert( (dest!=NULL)&&(src!=NULL) );
+	unsigned int q = 0;
+	unsigned int bit = 1;
 
-	 char *tmp_dest = (char*)dest;
-	 char *tmp_src = (char*)src;
+	if (d == 0)
+		return 0;
 
-	 while( count--)//不对是否存在重叠区域进行判断
-		  *tmp_dest++ = *tmp_src++;
+	while (d < n && !(d & 0x80000000))
+	{
+		d <<= 1;
+		bit <<= 1;
+	}
+
+	while (bit)
+	{
+		if (n >= d)
+		{
+			n -= d;
+			q |= bit;
+		}
+		d >>= 1;
+		bit >>= 1;
+	}
 
-	 return dest;
+	return q;
 }
 
 /*
@@ -1,3 +1,4 @@
+// n nanoseconds / 100ms on the ticks.c time base
 void ndelay(int n);
 
 void delay(void);
@@ -10,8 +11,13 @@ void putchar_hex(char c);
 
 void putint_hex(int a);
 
+// string.s: ldm/stm 32 bytes a step, memmove handles overlap
 void *memcpy(void *dest, const void *src, int count);
 
+void *memmove(void *dest, const void *src, int count);
+
+void *memset(void *s, int c, int count);
+
 char * strncpy ( char * dest, const char * source, int count );
 
 char* strcpy(char * dst, const char * src);
@@ -23,3 +29,5 @@ int strncmp ( char * s1, char * s2, int n);
 char * get_key_value(const char * key, char * buf, char * value);
 
 void printbuf(char * buff, int size);
+
+unsigned int udiv(unsigned int n, unsigned int d);
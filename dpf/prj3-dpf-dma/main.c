@@ -8,6 +8,15 @@
 #include "shell.h"
 #include "timer.h"
 #include "dma.h"
+#include "pmu.h"
+#include "mmu.h"
+#include "neon.h"
+#include "trace.h"
+#include "ticks.h"
+#include "vic.h"
+#include "event.h"
+#include "thread.h"
+#include "prof.h"
 
 int argc = 0;
 char * argv[32];
@@ -17,30 +26,214 @@ int bmpi = 0;
 #define BMP_SIZE	(0x80000)	// 512K
 #define BMP_FB_SIZE	(0x100000)	// 1M = 384K bmp file + 522K fb size
 #define WAV_FILE_ADDR	0x23000000
+#define BENCH_ADDR	0x28000000	// 3M scratch for the benches, the wav file stops below
 
-void user_irq_handler(void)
+#define SLIDE_INTERVAL	(4 * HZ)
+
+#define SLIDE_PRIO	(THREAD_PRIOS / 2 - 1)	// above the main loop
+
+static struct timer_list slide_timer;
+static struct sem slide_sem;
+static unsigned int slide_due;		// jiffies, of the last slide_tick()
+
+// main loop, from work_run(); the next one is due a whole interval after
+// this one was, however late this one runs
+static void slide_tick(void * ctx)
+{
+	slide_due = slide_timer.expires;
+	sem_post(&slide_sem);
+	mod_timer(&slide_timer, slide_timer.expires + SLIDE_INTERVAL);
+}
+
+// a thread of its own, above the main loop: it takes the CPU for one slide
+// a tick, the main loop has it with the wav and the keys the rest of the
+// time
+static void slide_show(void * arg)
 {
 	char * p;
 
-//	printf("^^^user irq handler\n");
+	while (1)
+	{
+		sem_wait(&slide_sem);
+
+		p = (char *)(BMP_ARRAY_ADDR + bmpi * BMP_FB_SIZE);
+
+		printf("^ dma show bmp[%d] = %s now (+%u ms)...", bmpi, argv[bmpi],
+			(jiffies - slide_due) * 1000 / HZ);
+		//lcd_draw_bmp((int)p);
+		dma_copy_parallel((int)p+BMP_SIZE, 0x22000000, 480*272*4);
+		printf("over!\n");
+
+		bmpi++;
+		if (bmpi == argc)
+			bmpi = 0;
+	}
+}
+
+// framebuffer copy: CPU memcpy against the DMA burst copy
+void fb_copy_bench(int src)
+{
+	int size = 480*272*4;
+	unsigned int cycles;
+	int mbps[4];
+	int i;
+
+	cycles = pmu_get_cycles();
+	memcpy((void *)0x22000000, (void *)src, size);
+	cycles = pmu_get_cycles() - cycles;
+	printf("fb copy: memcpy %d MB/s, ", udiv(size, cycles/1000 ? cycles/1000 : 1));
+
+	printf("dma %d MB/s\n", dma_copy(src, 0x22000000, size));
+	printf("dma programs: %d cached, %d generated\n", dma_cache_hits, dma_cache_misses);
+
+	// the same copy over 1, 2, 4 and 8 threads, the fastest is kept
+	if (dma_copy_calibrate(src, 0x22000000, size, mbps) > 0)
+		printf("dma split 1/2/4/8: %d/%d/%d/%d MB/s, using %d\n",
+			mbps[0], mbps[1], mbps[2], mbps[3], dma_copy_split);
+
+	// 200x100 window of the picture into the middle of the screen
+	cycles = pmu_get_cycles();
+	for (i = 0; i < 100; i++)
+		dma_copy(src + i*480*4, 0x22000000 + ((86+i)*480 + 140)*4, 200*4);
+	cycles = pmu_get_cycles() - cycles;
+	printf("rect 200x100: %d us row by row, ", cycles/1000);
+
+	cycles = pmu_get_cycles();
+	dma_copy_2d(src, 480*4, 0x22000000 + (86*480 + 140)*4, 480*4, 200*4, 100);
+	cycles = pmu_get_cycles() - cycles;
+	printf("%d us as one 2d program\n", cycles/1000);
+}
 
-//	printf("argc is 0x%x\n", argc);
-//	printf("argv is 0x%x\n", (int)argv);
-//	printf("bmpi is 0x%x\n", bmpi);
-//	printf("irq read file %s\n", argv[bmpi]);
-//	size = file_fat_read(argv[bmpi], p, 0x100000);
-	p = (char *)(BMP_ARRAY_ADDR + bmpi * BMP_FB_SIZE);
+// lib string functions against the byte loops they replaced, 512K of traffic per line
+static void byte_copy(char * d, const char * s, int n)
+{
+	while (n--)
+		*d++ = *s++;
+}
 
-	printf("^ dma show bmp[%d] = %s now...", bmpi, argv[bmpi]);
-	//lcd_draw_bmp((int)p);
-	dma_mem_transfer((int)p+BMP_SIZE, 0x22000000, 480*272*4);
-	printf("over!\n");
+static int mbps(int bytes, unsigned int cycles)
+{
+	cycles /= 1000;
+	return udiv(bytes, cycles ? cycles : 1);
+}
 
-	bmpi++;
-	if (bmpi == argc)
-		bmpi = 0;
+void string_bench(int buf)
+{
+	static const int sizes[] = { 64, 4096, 512 * 1024 };
+	static const int offs[][2] = { {0, 0}, {1, 1}, {0, 3} };	// dst, src
+	char * dst = (char *)buf;
+	char * src = (char *)(buf + 0x100000);
+	unsigned int t, tb;
+	int i, j, k, reps;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+		{
+			reps = udiv(512 * 1024, sizes[i]);
 
-	return;
+			tb = pmu_get_cycles();
+			for (k = 0; k < reps; k++)
+				byte_copy(dst + offs[j][0], src + offs[j][1], sizes[i]);
+			tb = pmu_get_cycles() - tb;
+
+			t = pmu_get_cycles();
+			for (k = 0; k < reps; k++)
+				memcpy(dst + offs[j][0], src + offs[j][1], sizes[i]);
+			t = pmu_get_cycles() - t;
+
+			printf("memcpy %d dst+%d src+%d: %d MB/s, byte loop %d MB/s\n", sizes[i],
+				offs[j][0], offs[j][1], mbps(512 * 1024, t), mbps(512 * 1024, tb));
+		}
+
+	t = pmu_get_cycles();
+	memmove(src + 4, src, 512 * 1024);
+	memmove(src, src + 4, 512 * 1024);
+	t = pmu_get_cycles() - t;
+	printf("memmove 512K overlapping, both ways: %d MB/s\n", mbps(1024 * 1024, t));
+
+	t = pmu_get_cycles();
+	memset(dst, 0, 512 * 1024);
+	t = pmu_get_cycles() - t;
+	printf("memset 512K: %d MB/s\n", mbps(512 * 1024, t));
+
+	memset(src, 'a', 4095);
+	src[4095] = '\0';
+	t = pmu_get_cycles();
+	for (k = 0; k < 128; k++)
+		strlen(src);
+	t = pmu_get_cycles() - t;
+	printf("strlen 4K: %d MB/s\n", mbps(128 * 4096, t));
+
+	memcpy(dst, src, 4096);
+	t = pmu_get_cycles();
+	for (k = 0; k < 128; k++)
+		strcmp(dst, src);
+	t = pmu_get_cycles() - t;
+	printf("strcmp 4K equal: %d MB/s\n", mbps(128 * 4096, t));
+}
+
+// a boot log line formatted only (snprintf) and sent out (printf)
+#define BOOT_LOG_LINE	"bmp[%d] = %s -> fb %p, %u bytes, crc %08x\n", \
+			i, "tian.bmp", (void *)0x21800000, 480*272*4, i * 0x9e3779b9
+
+#define TRACE_BENCH_EVENTS	1000
+
+void printf_bench(void)
+{
+	char line[96];
+	unsigned int t;
+	int i, n = 0;
+
+	t = pmu_get_cycles();
+	for (i = 0; i < 1000; i++)
+		n += snprintf(line, sizeof(line), BOOT_LOG_LINE);
+	t = pmu_get_cycles() - t;
+	printf("snprintf: 1000 lines, %d chars in %d us, %d chars/ms\n",
+		n, t/1000, udiv(n * 1000, t/1000 ? t/1000 : 1));
+
+	n = 0;
+	t = pmu_get_cycles();
+	for (i = 0; i < 10; i++)
+		n += printf(BOOT_LOG_LINE);
+	t = pmu_get_cycles() - t;
+	printf("printf: 10 lines, %d chars in %d us, %d chars/ms\n",
+		n, t/1000, udiv(n * 1000, t/1000 ? t/1000 : 1));
+
+	// the same line as a trace event, formatted later on the PC
+	t = pmu_get_cycles();
+	for (i = 0; i < TRACE_BENCH_EVENTS; i++)
+		TRACE(BOOT_LOG_LINE);
+	t = pmu_get_cycles() - t;
+	printf("trace: %d events in %d us, %d cycles/event\n",
+		TRACE_BENCH_EVENTS, t/1000, t/TRACE_BENCH_EVENTS);
+}
+
+// every source that fired: count, worst latency behind higher priorities
+// and worst handler time
+void irq_stats_show(void)
+{
+	const struct irq_stat * s;
+	int n;
+
+	for (n = 0; n < IRQ_NR; n++)
+	{
+		s = irq_get_stat(n);
+		if (s->count)
+			printf("irq %3d: %8u, latency max %u cycles, handler max %u us\n",
+				n, s->count, s->max_latency, s->max_cycles / 1000);
+	}
+}
+
+// b in the main loop, not at boot: the slides and the audio keep going
+// meanwhile, so the numbers include their interrupts
+void bench_run(void)
+{
+	if (argc > 0)
+		fb_copy_bench((int)BMP_ARRAY_ADDR+BMP_SIZE);
+	neon_bench(BENCH_ADDR);
+	string_bench(BENCH_ADDR);
+	printf_bench();
+	thread_bench();
 }
 
 char buf[1024];
@@ -49,6 +242,48 @@ char wavfilenames[512];
 
 void dma_test(void);
 
+// the dispatch of the main loop, from every wait in it: the deferred work
+// (the timer wheel, which wakes the slide thread) and the keys
+static void main_poll(void)
+{
+	char key;
+
+	work_run();
+
+	if (!uart_read(&key, 1))
+		return;
+	if (key == 't')
+		trace_dump();
+	if (key == 'i')
+	{
+		irq_stats_show();
+		work_stats_show();
+		timer_stats_show();
+		thread_show();
+	}
+	if (key == 'p')
+	{
+		if (prof_running())
+			prof_stop();
+		else
+			prof_start();
+		printf("profiler %s\n", prof_running() ? "on" : "off");
+	}
+	if (key == 'd')
+		prof_dump();
+	if (key == 'b')
+		bench_run();
+}
+
+// mdelay() that keeps polling
+static void main_wait(unsigned int ms)
+{
+	unsigned int end = jiffies + ms * HZ / 1000;
+
+	while (time_after(end, jiffies))
+		main_poll();
+}
+
 #if 0
 int mymain(void)
 {
@@ -90,7 +325,14 @@ int mymain(void)
 	char * wargv[10];
 
 	puts("init begin");
-//	uart_init();
+	irq_init();
+	// the audio dma gets in while the uart or timer handler runs
+	irq_nesting = 1;
+	uart_init();
+	mmu_init();
+	puts("mmu, caches on");
+	pmu_init();
+	dma_init();
 	SDHC_Init();
 	fat_init();
 	puts("sd fat init over");
@@ -127,7 +369,7 @@ int mymain(void)
 		size = file_fat_read(argv[i], p, 0x100000);
 		lcd_draw_bmp_v((int)p, (int)p+BMP_SIZE);
 		//lcd_draw_bmp((int)p);
-		dma_mem_transfer((int)p+BMP_SIZE, 0x22000000, 480*272*4);
+		dma_copy((int)p+BMP_SIZE, 0x22000000, 480*272*4);
 		p = p + BMP_FB_SIZE;
 	}
 	puts("bmp file -> fb data ok");
@@ -148,7 +390,7 @@ int mymain(void)
 				dma_mem_transfer(p+BMP_SIZE, 0x22000000, 480*272*4);
 
 			p = p + BMP_FB_SIZE;
-			ndelay(0x100000);
+			mdelay(1000);
 		}
 		mode = ++mode % 3;
 	}
@@ -156,6 +398,14 @@ int mymain(void)
 
 	bmpi = 0;
 	timer_init();
+	thread_init(THREAD_PRIOS / 2);
+	if (argc > 0)
+	{
+		sem_init(&slide_sem, 0);
+		thread_create("slides", slide_show, 0, SLIDE_PRIO);
+		setup_timer(&slide_timer, slide_tick, 0);
+		mod_timer(&slide_timer, jiffies + SLIDE_INTERVAL);
+	}
 	puts("timer init ok");
 
 	p = (char *)WAV_FILE_ADDR;
@@ -163,17 +413,29 @@ int mymain(void)
 	printf("WAV = <%s>\n", wavfilenames);
 
 	wargc = shell_parse(wavfilenames, wargv);
+	puts("press t for a trace dump (trace-decode/ on the PC), i for irq stats,");
+	puts("p to start / stop the profiler, d to dump it (prof-decode/ on the PC),");
+	puts("b to run the benches");
 	while (1)
 	{
 		for (i = 0; i < wargc; i++)
 		{
-			size = file_fat_read(wargv[i], p, 0x6400000);
+			size = file_fat_read(wargv[i], p, BENCH_ADDR - WAV_FILE_ADDR);
 			printf("play %s (size: %d) now ... ", wargv[i], size);
-			audio_play_wav((int)p, size);
+
+			// the dma irq refills the audio, the timer irq only posts the
+			// jiffy; the slides are shown from main_poll() while it plays
+			if (audio_play_wav_start((int)p, size) < 0)
+				continue;
+			while (audio_dma_busy())
+				main_poll();
 			printf("over!\n");
 
-			ndelay(10000);
+			main_wait(10);
 		}
+
+		// no wav, or none that plays: the slides and the keys go on
+		main_poll();
 	}
 
 	return 0;
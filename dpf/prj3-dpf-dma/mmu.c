@@ -0,0 +1,139 @@
+
+#include "mmu.h"
+
+// section descriptor: [1:0] 2 = section, [2] B, [3] C, [11:10] AP 3 = full access,
+// [14:12] TEX, domain 0
+#define SECT		((3 << 10) | 2)
+#define SECT_DEVICE	(SECT | (1 << 2))			// TEX 0 C 0 B 1: shareable device
+#define SECT_NOCACHE	(SECT | (1 << 12))			// TEX 1 C 0 B 0: normal, non-cacheable
+#define SECT_WBWA	(SECT | (1 << 12) | (1 << 3) | (1 << 2))	// TEX 1 C 1 B 1: normal, write-back write-allocate
+
+#define SDRAM_START	0x200		// in MB
+#define SDRAM_END	0x500
+#define FB_SECTION	0x220		// FB_ADDR of lcd.c
+
+// CP15 barriers: the toolchain defaults to ARMv6K, which has no dsb / isb
+// mnemonics (ARMv7), and the Cortex-A8 still takes the ARMv6 CP15 forms
+#define dsb()	__asm__ __volatile__("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory")
+#define isb()	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 4" : : "r" (0) : "memory")
+
+static unsigned int mmu_table[4096] __attribute__((aligned(16384)));
+
+// invalidate every data / unified cache level by set/way (L1 D and L2)
+static void dcache_inv_all(void)
+{
+	unsigned int clidr, ccsidr, level, ways, sets, lsh, wsh, w, s;
+
+	__asm__ __volatile__("mrc p15, 1, %0, c0, c0, 1" : "=r" (clidr));
+
+	for (level = 0; level < 7; level++) {
+		// Ctype: 2 data, 3 separate I/D, 4 unified; 0 no more levels
+		if (((clidr >> (level * 3)) & 7) < 2)
+			continue;
+
+		// CSSELR picks the level, CCSIDR then tells its geometry
+		__asm__ __volatile__("mcr p15, 2, %0, c0, c0, 0" : : "r" (level << 1));
+		isb();
+		__asm__ __volatile__("mrc p15, 1, %0, c0, c0, 0" : "=r" (ccsidr));
+
+		lsh = (ccsidr & 7) + 4;
+		ways = (ccsidr >> 3) & 0x3ff;
+		sets = (ccsidr >> 13) & 0x7fff;
+
+		// the way number sits in the top bits, 32 - log2(ways)
+		wsh = 32;
+		for (w = ways; w; w >>= 1)
+			wsh--;
+
+		for (w = 0; w <= ways; w++)
+			for (s = 0; s <= sets; s++)
+				__asm__ __volatile__("mcr p15, 0, %0, c7, c6, 2"
+					: : "r" ((w << wsh) | (s << lsh) | (level << 1)));
+	}
+	dsb();
+}
+
+void mmu_init(void)
+{
+	unsigned int v;
+	int i;
+
+	for (i = 0; i < 4096; i++)
+		mmu_table[i] = (i << 20) | SECT_DEVICE;
+	for (i = SDRAM_START; i < SDRAM_END; i++)
+		mmu_table[i] = (i << 20) | SECT_WBWA;
+	mmu_table[FB_SECTION] = (FB_SECTION << 20) | SECT_NOCACHE;
+	mmu_table[0x000] = (0x000 << 20) | SECT_NOCACHE;
+	mmu_table[0xD00] = (0xD00 << 20) | SECT_NOCACHE;
+
+	// nothing valid may be left in the caches, TLBs or branch predictor
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 0" : : "r" (0));	// ICIALLU
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 6" : : "r" (0));	// BPIALL
+	__asm__ __volatile__("mcr p15, 0, %0, c8, c7, 0" : : "r" (0));	// TLBIALL
+	dcache_inv_all();
+
+	// the table is written with the D-cache off, so walks can be non-cacheable
+	__asm__ __volatile__("mcr p15, 0, %0, c2, c0, 2" : : "r" (0));		// TTBCR: TTBR0 only
+	__asm__ __volatile__("mcr p15, 0, %0, c2, c0, 0" : : "r" (mmu_table));	// TTBR0
+	__asm__ __volatile__("mcr p15, 0, %0, c3, c0, 0" : : "r" (0x55555555));	// DACR: all client
+	dsb();
+
+	// ACTLR: [1] L2EN
+	__asm__ __volatile__("mrc p15, 0, %0, c1, c0, 1" : "=r" (v));
+	v |= 1 << 1;
+	__asm__ __volatile__("mcr p15, 0, %0, c1, c0, 1" : : "r" (v));
+
+	// SCTLR: [0] M, [2] C, [11] Z branch prediction, [12] I
+	__asm__ __volatile__("mrc p15, 0, %0, c1, c0, 0" : "=r" (v));
+	v |= (1 << 0) | (1 << 2) | (1 << 11) | (1 << 12);
+	__asm__ __volatile__("mcr p15, 0, %0, c1, c0, 0" : : "r" (v) : "memory");
+	isb();
+}
+
+void cache_clean_range(unsigned int start, int size)
+{
+	unsigned int p, end = start + size;
+
+	if (size <= 0)
+		return;
+
+	for (p = start & ~(CACHE_LINE - 1); p < end; p += CACHE_LINE)
+		__asm__ __volatile__("mcr p15, 0, %0, c7, c10, 1" : : "r" (p));	// DCCMVAC
+	dsb();
+}
+
+void cache_flush_range(unsigned int start, int size)
+{
+	unsigned int p, end = start + size;
+
+	if (size <= 0)
+		return;
+
+	for (p = start & ~(CACHE_LINE - 1); p < end; p += CACHE_LINE)
+		__asm__ __volatile__("mcr p15, 0, %0, c7, c14, 1" : : "r" (p));	// DCCIMVAC
+	dsb();
+}
+
+void cache_inv_range(unsigned int start, int size)
+{
+	unsigned int p, end = start + size;
+
+	if (size <= 0)
+		return;
+
+	// partial lines at both ends hold bytes outside the range
+	if (start & (CACHE_LINE - 1)) {
+		p = start & ~(CACHE_LINE - 1);
+		__asm__ __volatile__("mcr p15, 0, %0, c7, c14, 1" : : "r" (p));
+		start = p + CACHE_LINE;
+	}
+	if (end & (CACHE_LINE - 1)) {
+		p = end & ~(CACHE_LINE - 1);
+		__asm__ __volatile__("mcr p15, 0, %0, c7, c14, 1" : : "r" (p));
+		end = p;
+	}
+
+	for (p = start; p < end; p += CACHE_LINE)
+		__asm__ __volatile__("mcr p15, 0, %0, c7, c6, 1" : : "r" (p));	// DCIMVAC
+	dsb();
+}
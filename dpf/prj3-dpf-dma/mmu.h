@@ -0,0 +1,21 @@
+
+// Cortex-A8 MMU and caches: identity mapped 1MB sections
+//   0x20000000 ~ 0x4FFFFFFF SDRAM (DMC0 512MB, DMC1 256MB), write-back write-allocate
+//   0x22000000 ~ 0x220FFFFF the two LCD frame buffers, non-cacheable (writes combine)
+//   0x00000000, 0xD0000000 iROM / iRAM (vectors, irq stack), non-cacheable
+//   everything else device memory (SFRs)
+// mmu_init() also turns on the I-cache, the D-cache, L2 and branch prediction.
+
+#define CACHE_LINE	64	// L1 and L2 line size
+
+void mmu_init(void);
+
+// by address range, to the point of coherency (L1 and L2), for memory a
+// DMA master (PL330, SDHC SDMA, LCD) reads or writes behind the CPU's back:
+// clean   - before the device reads what the CPU wrote
+// inv     - before the device writes, the CPU then reads memory; lines only
+//           partly in the range are cleaned first so their other bytes stay
+// flush   - clean and invalidate
+void cache_clean_range(unsigned int start, int size);
+void cache_inv_range(unsigned int start, int size);
+void cache_flush_range(unsigned int start, int size);
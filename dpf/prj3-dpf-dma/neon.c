@@ -0,0 +1,227 @@
+
+// built with -mcpu=cortex-a8 -mfpu=neon, see the Makefile
+#include <arm_neon.h>
+
+#include "stdio.h"
+#include "lib.h"
+#include "pmu.h"
+#include "neon.h"
+
+int neon_present(void)
+{
+	unsigned int cpacr, fpexc;
+
+	// FPEXC is a CP10 register: reading it with CP10 / CP11 off traps, so
+	// CPACR[23:20] first
+	__asm__ __volatile__("mrc p15, 0, %0, c1, c0, 2" : "=r" (cpacr));
+	if (((cpacr >> 20) & 0xf) != 0xf)
+		return 0;
+
+	// [30] EN
+	__asm__ __volatile__("vmrs %0, fpexc" : "=r" (fpexc));
+
+	return (fpexc >> 30) & 1;
+}
+
+void neon_copy(void * dst, const void * src, int size)
+{
+	unsigned char * d = dst;
+	const unsigned char * s = src;
+	uint8x16_t a, b, c, e;
+
+	for (; size >= 64; size -= 64) {
+		a = vld1q_u8(s);
+		b = vld1q_u8(s + 16);
+		c = vld1q_u8(s + 32);
+		e = vld1q_u8(s + 48);
+		vst1q_u8(d, a);
+		vst1q_u8(d + 16, b);
+		vst1q_u8(d + 32, c);
+		vst1q_u8(d + 48, e);
+		s += 64;
+		d += 64;
+	}
+
+	while (size--)
+		*d++ = *s++;
+}
+
+void c_copy(void * dst, const void * src, int size)
+{
+	unsigned char * d = dst;
+	const unsigned char * s = src;
+
+	while (size--)
+		*d++ = *s++;
+}
+
+void neon_fill32(unsigned int * dst, unsigned int value, int count)
+{
+	uint32x4_t v = vdupq_n_u32(value);
+
+	for (; count >= 16; count -= 16) {
+		vst1q_u32(dst, v);
+		vst1q_u32(dst + 4, v);
+		vst1q_u32(dst + 8, v);
+		vst1q_u32(dst + 12, v);
+		dst += 16;
+	}
+
+	while (count--)
+		*dst++ = value;
+}
+
+void c_fill32(unsigned int * dst, unsigned int value, int count)
+{
+	while (count--)
+		*dst++ = value;
+}
+
+// VLD3 splits 16 pixels into blue, green and red lanes, VST4 interleaves them with 0
+void neon_bgr2xrgb(unsigned int * dst, const unsigned char * src, int pixels)
+{
+	uint8x16x3_t bgr;
+	uint8x16x4_t x;
+
+	x.val[3] = vdupq_n_u8(0);
+	for (; pixels >= 16; pixels -= 16) {
+		bgr = vld3q_u8(src);
+		x.val[0] = bgr.val[0];
+		x.val[1] = bgr.val[1];
+		x.val[2] = bgr.val[2];
+		vst4q_u8((unsigned char *)dst, x);
+		src += 48;
+		dst += 16;
+	}
+
+	c_bgr2xrgb(dst, src, pixels);
+}
+
+void c_bgr2xrgb(unsigned int * dst, const unsigned char * src, int pixels)
+{
+	while (pixels--) {
+		*dst++ = src[2] << 16 | src[1] << 8 | src[0];
+		src += 3;
+	}
+}
+
+// t = s * a + d * (255 - a), t / 255 as (t + ((t + 128) >> 8) + 128) >> 8
+void neon_blend(unsigned int * dst, const unsigned int * src, int alpha, int pixels)
+{
+	uint8x8_t va = vdup_n_u8(alpha), vna = vdup_n_u8(255 - alpha);
+	uint8x8_t s, d;
+	uint16x8_t t;
+
+	for (; pixels >= 2; pixels -= 2) {
+		s = vld1_u8((const unsigned char *)src);
+		d = vld1_u8((const unsigned char *)dst);
+		t = vmull_u8(s, va);
+		t = vmlal_u8(t, d, vna);
+		vst1_u8((unsigned char *)dst, vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+		src += 2;
+		dst += 2;
+	}
+
+	c_blend(dst, src, alpha, pixels);
+}
+
+void c_blend(unsigned int * dst, const unsigned int * src, int alpha, int pixels)
+{
+	const unsigned char * s = (const unsigned char *)src;
+	unsigned char * d = (unsigned char *)dst;
+	unsigned int t;
+	int i;
+
+	for (i = 0; i < pixels * 4; i++) {
+		t = s[i] * alpha + d[i] * (255 - alpha);
+		d[i] = (t + ((t + 128) >> 8) + 128) >> 8;
+	}
+}
+
+void neon_mix16(short * dst, const short * a, const short * b, int samples)
+{
+	for (; samples >= 8; samples -= 8) {
+		vst1q_s16(dst, vqaddq_s16(vld1q_s16(a), vld1q_s16(b)));
+		a += 8;
+		b += 8;
+		dst += 8;
+	}
+
+	c_mix16(dst, a, b, samples);
+}
+
+void c_mix16(short * dst, const short * a, const short * b, int samples)
+{
+	int v;
+
+	while (samples--) {
+		v = *a++ + *b++;
+		if (v > 32767)
+			v = 32767;
+		if (v < -32768)
+			v = -32768;
+		*dst++ = v;
+	}
+}
+
+#define BENCH_PIXELS	(480 * 272)
+
+static void bench_line(const char * what, unsigned int c, unsigned int neon)
+{
+	printf("%s: c %d us, neon %d us, x%d\n", what, c / 1000, neon / 1000,
+		udiv(c, neon ? neon : 1));
+}
+
+// one frame worth of each kernel: 1MB src at buf, 1MB dst at buf + 2MB
+void neon_bench(int buf)
+{
+	unsigned int * src = (unsigned int *)buf;
+	unsigned int * dst = (unsigned int *)(buf + 0x200000);
+	unsigned int c, neon;
+
+	if (!neon_present()) {
+		puts("neon bench: NEON is off");
+		return;
+	}
+
+	c = pmu_get_cycles();
+	c_copy(dst, src, BENCH_PIXELS * 4);
+	c = pmu_get_cycles() - c;
+	neon = pmu_get_cycles();
+	neon_copy(dst, src, BENCH_PIXELS * 4);
+	neon = pmu_get_cycles() - neon;
+	bench_line("copy 510KB", c, neon);
+
+	c = pmu_get_cycles();
+	c_fill32(dst, 0x00ff00, BENCH_PIXELS);
+	c = pmu_get_cycles() - c;
+	neon = pmu_get_cycles();
+	neon_fill32(dst, 0x00ff00, BENCH_PIXELS);
+	neon = pmu_get_cycles() - neon;
+	bench_line("fill 480x272", c, neon);
+
+	c = pmu_get_cycles();
+	c_bgr2xrgb(dst, (unsigned char *)src, BENCH_PIXELS);
+	c = pmu_get_cycles() - c;
+	neon = pmu_get_cycles();
+	neon_bgr2xrgb(dst, (unsigned char *)src, BENCH_PIXELS);
+	neon = pmu_get_cycles() - neon;
+	bench_line("bgr888 -> xrgb 480x272", c, neon);
+
+	c = pmu_get_cycles();
+	c_blend(dst, src, 96, BENCH_PIXELS);
+	c = pmu_get_cycles() - c;
+	neon = pmu_get_cycles();
+	neon_blend(dst, src, 96, BENCH_PIXELS);
+	neon = pmu_get_cycles() - neon;
+	bench_line("blend 480x272", c, neon);
+
+	// 44.1kHz stereo for 1s: 88200 samples of each source
+	c = pmu_get_cycles();
+	c_mix16((short *)dst, (short *)src, (short *)src + 88200, 88200);
+	c = pmu_get_cycles() - c;
+	neon = pmu_get_cycles();
+	neon_mix16((short *)dst, (short *)src, (short *)src + 88200, 88200);
+	neon = pmu_get_cycles() - neon;
+	bench_line("mix 1s of 44.1kHz stereo", c, neon);
+}
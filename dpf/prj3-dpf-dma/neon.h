@@ -0,0 +1,29 @@
+
+// NEON kernels for the hot loops, each with a plain C version of the same
+// result; start.s enables CP10/CP11 and FPEXC.EN, neon_present() tells if
+// that happened
+
+int neon_present(void);
+
+// size bytes, any alignment
+void neon_copy(void * dst, const void * src, int size);
+void c_copy(void * dst, const void * src, int size);
+
+// count words of value
+void neon_fill32(unsigned int * dst, unsigned int value, int count);
+void c_fill32(unsigned int * dst, unsigned int value, int count);
+
+// BMP pixels (blue, green, red bytes) -> frame buffer words 0x00RRGGBB
+void neon_bgr2xrgb(unsigned int * dst, const unsigned char * src, int pixels);
+void c_bgr2xrgb(unsigned int * dst, const unsigned char * src, int pixels);
+
+// dst = (src * alpha + dst * (255 - alpha)) / 255 per byte, alpha 0 ~ 255
+void neon_blend(unsigned int * dst, const unsigned int * src, int alpha, int pixels);
+void c_blend(unsigned int * dst, const unsigned int * src, int alpha, int pixels);
+
+// dst = a + b per 16-bit sample, saturated
+void neon_mix16(short * dst, const short * a, const short * b, int samples);
+void c_mix16(short * dst, const short * a, const short * b, int samples);
+
+// cycles of both versions of every kernel on buffers from buf (3MB of SDRAM)
+void neon_bench(int buf);
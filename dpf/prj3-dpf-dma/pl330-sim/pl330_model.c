@@ -0,0 +1,353 @@
+// PL330 thread interpreter, see pl330_model.h
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "pl330_model.h"
+
+#define MFIFO_SIZE	(64 * 1024)
+
+char pl330_error[128];
+
+static const char * cond_name(unsigned char op)
+{
+	// x (bit 0) makes the instruction conditional, bs (bit 1) picks burst
+	if (!(op & 1))
+		return "";
+	return (op & 2) ? "B" : "S";
+}
+
+static unsigned int le32(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+int pl330_disasm(const unsigned char * buf, char * out, int outlen)
+{
+	unsigned char op = buf[0];
+
+	switch (op) {
+	case 0x00:
+		snprintf(out, outlen, "DMAEND");
+		return 1;
+	case 0x01:
+		snprintf(out, outlen, "DMAKILL");
+		return 1;
+	case 0x04: case 0x05: case 0x07:
+		snprintf(out, outlen, "DMALD%s", cond_name(op));
+		return 1;
+	case 0x08: case 0x09: case 0x0b:
+		snprintf(out, outlen, "DMAST%s", cond_name(op));
+		return 1;
+	case 0x0c:
+		snprintf(out, outlen, "DMASTZ");
+		return 1;
+	case 0x12:
+		snprintf(out, outlen, "DMARMB");
+		return 1;
+	case 0x13:
+		snprintf(out, outlen, "DMAWMB");
+		return 1;
+	case 0x18:
+		snprintf(out, outlen, "DMANOP");
+		return 1;
+	case 0x20: case 0x22:
+		snprintf(out, outlen, "DMALP lc%d, %d", (op >> 1) & 1, buf[1] + 1);
+		return 2;
+	case 0x25: case 0x27:
+		snprintf(out, outlen, "DMALDP%s P%d", cond_name(op), buf[1] >> 3);
+		return 2;
+	case 0x29: case 0x2b:
+		snprintf(out, outlen, "DMASTP%s P%d", cond_name(op), buf[1] >> 3);
+		return 2;
+	case 0x28: case 0x2c: case 0x2d: case 0x2f:
+		snprintf(out, outlen, "DMALPFE%s -%d", cond_name(op), buf[1]);
+		return 2;
+	case 0x38: case 0x39: case 0x3b:
+	case 0x3c: case 0x3d: case 0x3f:
+		snprintf(out, outlen, "DMALPEND%s lc%d, -%d", cond_name(op), (op >> 2) & 1, buf[1]);
+		return 2;
+	case 0x30: case 0x31: case 0x32:
+		snprintf(out, outlen, "DMAWFP%s P%d",
+			op == 0x30 ? "S" : (op == 0x32 ? "B" : "P"), buf[1] >> 3);
+		return 2;
+	case 0x34:
+		snprintf(out, outlen, "DMASEV %d", buf[1] >> 3);
+		return 2;
+	case 0x35:
+		snprintf(out, outlen, "DMAFLUSHP P%d", buf[1] >> 3);
+		return 2;
+	case 0x36:
+		snprintf(out, outlen, "DMAWFE %d%s", buf[1] >> 3, (buf[1] & 2) ? ", invalid" : "");
+		return 2;
+	case 0x54: case 0x56:
+		snprintf(out, outlen, "DMAADDH %s, 0x%x", (op & 2) ? "DAR" : "SAR", buf[1] | (buf[2] << 8));
+		return 3;
+	case 0x5c: case 0x5e:
+		snprintf(out, outlen, "DMAADNH %s, 0x%x", (op & 2) ? "DAR" : "SAR", buf[1] | (buf[2] << 8));
+		return 3;
+	case 0xa0: case 0xa2:
+		snprintf(out, outlen, "DMAGO C%d, 0x%08x%s", buf[1] & 7, le32(&buf[2]), (op & 2) ? ", ns" : "");
+		return 6;
+	case 0xbc:
+		snprintf(out, outlen, "DMAMOV %s, 0x%08x",
+			buf[1] == 0 ? "SAR" : (buf[1] == 1 ? "CCR" : (buf[1] == 2 ? "DAR" : "???")), le32(&buf[2]));
+		return buf[1] <= 2 ? 6 : -1;
+	}
+
+	snprintf(out, outlen, "unknown 0x%02x", op);
+	return -1;
+}
+
+void pl330_dump(const unsigned char * prog, int len)
+{
+	char text[64];
+	int off = 0, n;
+
+	while (off < len) {
+		n = pl330_disasm(&prog[off], text, sizeof(text));
+		printf("  %03x: %s\n", off, text);
+		if (n < 0)
+			break;
+		off += n;
+	}
+}
+
+static int fail(const char * fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(pl330_error, sizeof(pl330_error), fmt, ap);
+	va_end(ap);
+
+	return -1;
+}
+
+static struct pl330_mem * find(struct pl330_mem * mem, int nmem, unsigned int addr, unsigned int len)
+{
+	int i;
+
+	for (i = 0; i < nmem; i++)
+		if (addr >= mem[i].base && addr - mem[i].base + len <= mem[i].size)
+			return &mem[i];
+
+	return 0;
+}
+
+struct thread {
+	unsigned int pc, sar, dar, ccr;
+	unsigned int lc[2];
+	int req_burst;			// request flag of the last DMAWFP, 0: single
+	unsigned char fifo[MFIFO_SIZE];
+	unsigned int head, fill;	// MFIFO ring
+};
+
+static struct thread t;
+
+// one AXI read burst of len beats of size bytes into the MFIFO
+static int load(struct pl330_mem * mem, int nmem, unsigned int len, struct pl330_stats * st)
+{
+	unsigned int size = 1 << ((t.ccr >> 1) & 7);
+	int inc = t.ccr & 1;
+	unsigned int bytes = len * size, i;
+	struct pl330_mem * m;
+
+	if (t.fill + bytes > MFIFO_SIZE)
+		return fail("MFIFO overflow at 0x%x", t.pc);
+	if (inc && (t.sar >> 12) != ((t.sar + bytes - 1) >> 12))
+		st->cross_4k++;
+
+	for (i = 0; i < bytes; i++) {
+		unsigned int a = inc ? t.sar + i : t.sar + (i & (size - 1));
+
+		m = find(mem, nmem, a, 1);
+		if (!m)
+			return fail("read of 0x%08x outside memory at 0x%x", a, t.pc);
+		t.fifo[(t.head + t.fill) % MFIFO_SIZE] = m->fifo ? 0 : m->data[a - m->base];
+		t.fill++;
+	}
+	if (inc)
+		t.sar += bytes;
+
+	st->rd_bursts++;
+	st->rd_beats += len;
+	if (t.fill > st->mfifo_max)
+		st->mfifo_max = t.fill;
+
+	return 0;
+}
+
+// one AXI write burst out of the MFIFO, zeros for DMASTZ
+static int store(struct pl330_mem * mem, int nmem, unsigned int len, int zero, struct pl330_stats * st)
+{
+	unsigned int size = 1 << ((t.ccr >> 15) & 7);
+	int inc = (t.ccr >> 14) & 1;
+	unsigned int bytes = len * size, i;
+	unsigned char c;
+	struct pl330_mem * m;
+
+	if (!zero && t.fill < bytes)
+		return fail("MFIFO underrun at 0x%x: store of %u bytes, %u loaded", t.pc, bytes, t.fill);
+	if (inc && (t.dar >> 12) != ((t.dar + bytes - 1) >> 12))
+		st->cross_4k++;
+
+	for (i = 0; i < bytes; i++) {
+		unsigned int a = inc ? t.dar + i : t.dar + (i & (size - 1));
+
+		if (zero) {
+			c = 0;
+		} else {
+			c = t.fifo[t.head];
+			t.head = (t.head + 1) % MFIFO_SIZE;
+			t.fill--;
+		}
+
+		m = find(mem, nmem, a, 1);
+		if (!m)
+			return fail("write of 0x%08x outside memory at 0x%x", a, t.pc);
+		if (a < st->wr_lo)
+			st->wr_lo = a;
+		if (a > st->wr_hi)
+			st->wr_hi = a;
+		if (m->fifo) {
+			if (m->len < m->size)
+				m->data[m->len] = c;
+			m->len++;
+		} else {
+			m->data[a - m->base] = c;
+		}
+	}
+	if (inc)
+		t.dar += bytes;
+
+	st->wr_bursts++;
+	st->wr_beats += len;
+	st->bytes += bytes;
+
+	return 0;
+}
+
+// conditional instructions run if their S/B matches the request flag
+static int cond_ok(unsigned char op)
+{
+	if (!(op & 1))
+		return 1;
+	return ((op >> 1) & 1) == t.req_burst;
+}
+
+int pl330_run(const unsigned char * prog, int len, struct pl330_mem * mem, int nmem,
+		unsigned long max_events, int trace, struct pl330_stats * st)
+{
+	unsigned char op;
+	unsigned int blen;
+	char text[64];
+	int n;
+
+	memset(st, 0, sizeof(*st));
+	st->wr_lo = 0xffffffff;
+	memset(&t, 0, sizeof(t));
+	pl330_error[0] = '\0';
+
+	while (1) {
+		if (t.pc >= (unsigned int)len)
+			return fail("pc 0x%x ran off the program (%d bytes)", t.pc, len);
+		n = pl330_disasm(&prog[t.pc], text, sizeof(text));
+		if (n < 0 || t.pc + n > (unsigned int)len)
+			return fail("bad instruction at 0x%x: %s", t.pc, text);
+		if (trace)
+			printf("  %03x: %-28s SAR %08x DAR %08x lc %u/%u fifo %u\n",
+				t.pc, text, t.sar, t.dar, t.lc[0], t.lc[1], t.fill);
+
+		op = prog[t.pc];
+		st->insns++;
+		blen = ((t.ccr >> 4) & 0xf) + 1;
+
+		switch (op) {
+		case 0x00:
+			if (t.fill)
+				return fail("DMAEND with %u bytes left in the MFIFO", t.fill);
+			goto out;
+		case 0x01:
+			return fail("DMAKILL at 0x%x", t.pc);
+		case 0x04: case 0x05: case 0x07:
+		case 0x25: case 0x27:
+			// DMALDS/DMALDPS move one beat, the others a CCR burst
+			if (cond_ok(op) && load(mem, nmem, (op & 3) == 1 ? 1 : blen, st) < 0)
+				return -1;
+			break;
+		case 0x08: case 0x09: case 0x0b:
+		case 0x29: case 0x2b:
+			blen = ((t.ccr >> 18) & 0xf) + 1;
+			if (cond_ok(op) && store(mem, nmem, (op & 3) == 1 ? 1 : blen, 0, st) < 0)
+				return -1;
+			break;
+		case 0x0c:
+			if (store(mem, nmem, ((t.ccr >> 18) & 0xf) + 1, 1, st) < 0)
+				return -1;
+			break;
+		case 0x12: case 0x13: case 0x18: case 0x35: case 0x36:
+			break;
+		case 0x20: case 0x22:
+			t.lc[(op >> 1) & 1] = prog[t.pc + 1];
+			break;
+		case 0x28: case 0x2c: case 0x2d: case 0x2f:
+			// DMALPFE
+			if (cond_ok(op)) {
+				t.pc -= prog[t.pc + 1];
+				continue;
+			}
+			break;
+		case 0x38: case 0x39: case 0x3b:
+		case 0x3c: case 0x3d: case 0x3f:
+			if (cond_ok(op) && t.lc[(op >> 2) & 1]) {
+				t.lc[(op >> 2) & 1]--;
+				t.pc -= prog[t.pc + 1];
+				continue;
+			}
+			break;
+		case 0x30: case 0x31: case 0x32:
+			// the peripheral is always ready, DMAWFPP asks for singles
+			t.req_burst = op == 0x32;
+			st->peri_reqs++;
+			break;
+		case 0x34:
+			st->events++;
+			if (max_events && st->events >= max_events)
+				goto stop;
+			break;
+		case 0x54: case 0x56:
+			if (op & 2)
+				t.dar += prog[t.pc + 1] | (prog[t.pc + 2] << 8);
+			else
+				t.sar += prog[t.pc + 1] | (prog[t.pc + 2] << 8);
+			break;
+		case 0x5c: case 0x5e:
+			if (op & 2)
+				t.dar += 0xffff0000 | prog[t.pc + 1] | (prog[t.pc + 2] << 8);
+			else
+				t.sar += 0xffff0000 | prog[t.pc + 1] | (prog[t.pc + 2] << 8);
+			break;
+		case 0xbc:
+			if (prog[t.pc + 1] == 0)
+				t.sar = le32(&prog[t.pc + 2]);
+			else if (prog[t.pc + 1] == 1)
+				t.ccr = le32(&prog[t.pc + 2]);
+			else
+				t.dar = le32(&prog[t.pc + 2]);
+			break;
+		default:
+			return fail("%s at 0x%x is not allowed in a thread", text, t.pc);
+		}
+
+		t.pc += n;
+	}
+
+stop:
+	st->cycles = st->insns + st->rd_beats + st->wr_beats + 4 * (st->rd_bursts + st->wr_bursts);
+	return 1;
+out:
+	st->cycles = st->insns + st->rd_beats + st->wr_beats + 4 * (st->rd_bursts + st->wr_bursts);
+	return 0;
+}
@@ -0,0 +1,45 @@
+// PC model of one PL330 thread: disassembler and interpreter of the
+// programs pl330.c generates, against windows of simulated memory.
+
+#ifndef __PL330_MODEL_H__
+#define __PL330_MODEL_H__
+
+// a window of the target address space; writes to a fifo window (a
+// peripheral data register) are appended to data instead of stored
+struct pl330_mem {
+	unsigned int base;
+	unsigned int size;
+	unsigned char * data;
+	int fifo;
+	unsigned long len;		// fifo: bytes appended so far, up to size
+};
+
+struct pl330_stats {
+	unsigned long insns;		// instructions executed
+	unsigned long rd_bursts;	// AXI read transactions (DMALD*)
+	unsigned long rd_beats;
+	unsigned long wr_bursts;	// AXI write transactions (DMAST*)
+	unsigned long wr_beats;
+	unsigned long bytes;		// bytes stored
+	unsigned long peri_reqs;	// DMAWFP
+	unsigned long events;		// DMASEV
+	unsigned long cross_4k;		// bursts crossing a 4KB boundary, illegal on AXI
+	unsigned long mfifo_max;	// most bytes the MFIFO held
+	unsigned long cycles;		// rough: instructions + beats + 4 per burst
+	unsigned int wr_lo, wr_hi;	// lowest and highest address written
+};
+
+// length of the instruction at buf and its text in out, -1 if unknown
+int pl330_disasm(const unsigned char * buf, char * out, int outlen);
+
+// print a program, one instruction per line with its offset
+void pl330_dump(const unsigned char * prog, int len);
+
+// run prog from offset 0 until DMAEND (0), max_events DMASEV (1) or an
+// error (-1, text in pl330_error). trace prints every instruction.
+int pl330_run(const unsigned char * prog, int len, struct pl330_mem * mem, int nmem,
+		unsigned long max_events, int trace, struct pl330_stats * st);
+
+extern char pl330_error[128];
+
+#endif
@@ -0,0 +1,424 @@
+// pl330-sim: generate PL330 programs with ../pl330.c, run them on the
+// interpreter in pl330_model.c and check the result byte by byte
+//
+// pl330-sim [-d] [-t] copy size [src_off dst_off]
+// pl330-sim [-d] [-t] fill size value [dst_off]
+// pl330-sim [-d] [-t] 2d width height src_stride dst_stride [src_off dst_off]
+// pl330-sim [-d] [-t] sg count [seed]
+// pl330-sim [-d] [-t] peri size
+// pl330-sim [-d] [-t] ring period periods [events]
+// pl330-sim test
+//
+// -d disassembles the program, -t traces every instruction. test runs a
+// sweep of sizes, alignments and windows and fails on the first mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../dma.h"
+#include "../pl330.h"
+#include "pl330_model.h"
+
+#define SRC_BASE	0x23000000	// where the frame buffers and files sit on the board
+#define DST_BASE	0x22000000
+#define WIN_SIZE	(4 * 1024 * 1024)
+#define PERI_ADDR	0xE2900020	// UTXH0
+#define PAT_OFF		(WIN_SIZE - 8)	// fill pattern at the end of the source window
+#define PROG_SIZE	4096		// generate more than DMA_MC_SIZE to see how big it gets
+
+static unsigned char src_mem[WIN_SIZE], dst_mem[WIN_SIZE], ref[WIN_SIZE];
+static unsigned char peri_log[WIN_SIZE];
+static unsigned char prog[PROG_SIZE];
+static struct pl330_mem mem[3];
+static struct pl330_stats st;
+static int dump, trace;
+
+// random source, dst and ref the same pattern; check() puts back what it looked at
+static void setup(void)
+{
+	static int done;
+	int i;
+
+	if (!done) {
+		for (i = 0; i < WIN_SIZE; i++)
+			src_mem[i] = rand();
+		memset(dst_mem, 0xa5, WIN_SIZE);
+		memset(ref, 0xa5, WIN_SIZE);
+		done = 1;
+	}
+
+	mem[0].base = SRC_BASE;
+	mem[0].size = WIN_SIZE;
+	mem[0].data = src_mem;
+	mem[1].base = DST_BASE;
+	mem[1].size = WIN_SIZE;
+	mem[1].data = dst_mem;
+	mem[2].base = PERI_ADDR;
+	mem[2].size = 4;
+	mem[2].data = peri_log;
+	mem[2].fifo = 1;
+	mem[2].len = 0;
+}
+
+// run the program, print what it did, 0 if it ran to its end (or events)
+static int run(const char * what, int len, int dry_len, unsigned long events, int quiet)
+{
+	int ret;
+
+	if (len != dry_len) {
+		printf("%s: dry run says %d bytes, program has %d\n", what, dry_len, len);
+		return -1;
+	}
+	if (dump)
+		pl330_dump(prog, len);
+
+	ret = pl330_run(prog, len, mem, 3, events, trace, &st);
+	if (ret < 0) {
+		printf("%s: %s\n", what, pl330_error);
+		return -1;
+	}
+
+	if (!quiet)
+		printf("%s: %d bytes of microcode%s, %lu insns, %lu+%lu bursts, %lu+%lu beats, "
+		"%lu bytes, mfifo %lu, ~%lu cycles",
+		what, len, len > DMA_MC_SIZE ? " (too big for a channel)" : "", st.insns,
+		st.rd_bursts, st.wr_bursts, st.rd_beats, st.wr_beats, st.bytes,
+		st.mfifo_max, st.cycles);
+	if (!quiet && st.peri_reqs)
+		printf(", %lu requests", st.peri_reqs);
+	if (!quiet && st.events)
+		printf(", %lu events", st.events);
+	if (!quiet)
+		printf("\n");
+
+	if (st.cross_4k) {
+		printf("%s: %lu bursts cross a 4KB boundary\n", what, st.cross_4k);
+		return -1;
+	}
+
+	return 0;
+}
+
+// dst against ref over [lo, hi) and wherever the program wrote
+static int check(const char * what, unsigned int lo, unsigned int hi)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (st.wr_hi >= DST_BASE && st.wr_lo - DST_BASE < lo)
+		lo = st.wr_lo - DST_BASE;
+	if (st.wr_hi >= DST_BASE && st.wr_hi - DST_BASE + 1 > hi)
+		hi = st.wr_hi - DST_BASE + 1;
+
+	for (i = lo; i < hi; i++)
+		if (dst_mem[i] != ref[i]) {
+			printf("%s: dst+0x%x is 0x%02x, expected 0x%02x\n", what, i, dst_mem[i], ref[i]);
+			ret = -1;
+			break;
+		}
+
+	memset(&dst_mem[lo], 0xa5, hi - lo);
+	memset(&ref[lo], 0xa5, hi - lo);
+
+	return ret;
+}
+
+static int copy(unsigned int size, unsigned int soff, unsigned int doff, int quiet)
+{
+	char what[64];
+	int len, dry;
+
+	if (soff + size > WIN_SIZE || doff + size > WIN_SIZE)
+		return -1;
+
+	setup();
+	dry = pl330_copy_prog(1, prog, SRC_BASE + soff, DST_BASE + doff, size, 0);
+	dry += pl330_tail(1, prog, 0);
+	if (dry > PROG_SIZE)
+		return -1;
+	len = pl330_copy_prog(0, prog, SRC_BASE + soff, DST_BASE + doff, size, 0);
+	len += pl330_tail(0, &prog[len], 0);
+
+	memcpy(&ref[doff], &src_mem[soff], size);
+
+	snprintf(what, sizeof(what), "copy %u 0x%x->0x%x", size, soff, doff);
+	if (run(what, len, dry, 0, quiet) < 0)
+		return -1;
+
+	return check(what, doff, doff + size);
+}
+
+// dst + i gets byte (dst + i) & 3 of value, as the board has it for word fills
+static int fill(unsigned int size, unsigned int value, unsigned int doff, int quiet)
+{
+	char what[64];
+	unsigned int i;
+	int len, dry, zero = value == 0;
+
+	if (doff + size > WIN_SIZE)
+		return -1;
+
+	setup();
+	memcpy(&src_mem[PAT_OFF], &value, 4);
+	memcpy(&src_mem[PAT_OFF + 4], &value, 4);
+	dry = pl330_fill_prog(1, prog, SRC_BASE + PAT_OFF, DST_BASE + doff, size, zero);
+	dry += pl330_tail(1, prog, 0);
+	if (dry > PROG_SIZE)
+		return -1;
+	len = pl330_fill_prog(0, prog, SRC_BASE + PAT_OFF, DST_BASE + doff, size, zero);
+	len += pl330_tail(0, &prog[len], 0);
+
+	for (i = doff; i < doff + size; i++)
+		ref[i] = value >> ((i & 3) * 8);
+
+	snprintf(what, sizeof(what), "fill %u 0x%x ->0x%x", size, value, doff);
+	if (run(what, len, dry, 0, quiet) < 0)
+		return -1;
+	if (zero && st.rd_beats) {
+		printf("%s: zero fill read %lu beats\n", what, st.rd_beats);
+		return -1;
+	}
+
+	return check(what, doff, doff + size);
+}
+
+static int rect(unsigned int w, unsigned int h, unsigned int ss, unsigned int ds,
+		unsigned int soff, unsigned int doff)
+{
+	char what[64];
+	unsigned int y;
+	int len, dry;
+
+	if (ss < w || ds < w || soff + ss * h > WIN_SIZE || doff + ds * h > WIN_SIZE)
+		return -1;
+
+	setup();
+	dry = pl330_rect_prog(1, prog, SRC_BASE + soff, ss, DST_BASE + doff, ds, w, h);
+	snprintf(what, sizeof(what), "2d %ux%u %u/%u 0x%x->0x%x", w, h, ss, ds, soff, doff);
+	if (dry < 0) {
+		printf("%s: a row does not fit a DMALPEND jump\n", what);
+		return -1;
+	}
+	len = pl330_rect_prog(0, prog, SRC_BASE + soff, ss, DST_BASE + doff, ds, w, h);
+	dry += pl330_tail(1, prog, 0);
+	len += pl330_tail(0, &prog[len], 0);
+
+	for (y = 0; y < h; y++)
+		memcpy(&ref[doff + y * ds], &src_mem[soff + y * ss], w);
+
+	if (run(what, len, dry, 0, 0) < 0)
+		return -1;
+
+	return check(what, doff, doff + ds * h);
+}
+
+// 1 if the list ran fine but its program is one dma_copy_sg_async() refuses
+static int sg(int n, unsigned int seed)
+{
+	struct dma_sg list[64];
+	unsigned int d = 0;
+	char what[64];
+	int i, len, dry;
+
+	if (n < 1 || n > 64)
+		return -1;
+
+	setup();
+	srand(seed);
+	for (i = 0; i < n; i++) {
+		list[i].size = rand() % 20000;
+		list[i].src = SRC_BASE + rand() % (WIN_SIZE / 2);
+		d += rand() % 64;
+		list[i].dst = DST_BASE + d;
+		d += list[i].size;
+		memcpy(&ref[list[i].dst - DST_BASE], &src_mem[list[i].src - SRC_BASE], list[i].size);
+	}
+
+	dry = pl330_sg_prog(1, prog, list, n) + pl330_tail(1, prog, 0);
+	if (dry > PROG_SIZE)
+		return -1;
+	len = pl330_sg_prog(0, prog, list, n);
+	len += pl330_tail(0, &prog[len], 0);
+
+	snprintf(what, sizeof(what), "sg %d seed %u", n, seed);
+	if (run(what, len, dry, 0, 0) < 0 || check(what, 0, d) < 0)
+		return -1;
+
+	// the same test as in dma_copy_sg_async()
+	return dry > DMA_MC_SIZE;
+}
+
+static int peri(int size)
+{
+	int len, dry, sar, dar;
+
+	if (size < 1 || size > 256)
+		return -1;
+
+	setup();
+	dry = pl330_peri_prog(1, prog, SRC_BASE, PERI_ADDR, 1, size, 0, &sar, &dar);
+	len = pl330_peri_prog(0, prog, SRC_BASE, PERI_ADDR, 1, size, 0, &sar, &dar);
+	mem[2].size = WIN_SIZE;
+
+	if (run("peri", len, dry, 0, 0) < 0)
+		return -1;
+	if (mem[2].len != (unsigned long)size || memcmp(peri_log, src_mem, size)) {
+		printf("peri: %lu bytes reached the peripheral, expected %d\n", mem[2].len, size);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ring(int period, int periods, unsigned long events)
+{
+	unsigned long i, n;
+	int len, dry;
+
+	setup();
+	dry = pl330_ring_prog(1, prog, SRC_BASE, period, periods, PERI_ADDR, 10, 0);
+	if (dry < 0) {
+		printf("ring: period %d x %d not supported\n", period, periods);
+		return -1;
+	}
+	len = pl330_ring_prog(0, prog, SRC_BASE, period, periods, PERI_ADDR, 10, 0);
+	mem[2].size = WIN_SIZE;
+
+	if (run("ring", len, dry, events, 0) < 0)
+		return -1;
+
+	// the samples go out in ring order, period after period
+	n = mem[2].len;
+	if (n != events * period) {
+		printf("ring: %lu bytes reached the peripheral after %lu events, expected %lu\n",
+			n, events, events * period);
+		return -1;
+	}
+	for (i = 0; i < n && i < WIN_SIZE; i++)
+		if (peri_log[i] != src_mem[i % (period * periods)]) {
+			printf("ring: byte %lu differs\n", i);
+			return -1;
+		}
+
+	return 0;
+}
+
+// sizes and alignments the board meets, plus the edges of every loop
+static int test(void)
+{
+	static const unsigned int sizes[] = {
+		1, 2, 3, 7, 8, 9, 15, 16, 17, 127, 128, 129, 255, 256, 257,
+		4095, 4096, 4097, 32768, 32769, 65535, 65536, 65537, 480*272*4,
+		128*256 + 1, 128*256*256, 128*256*256 + 8 + 3,
+	};
+	static const unsigned int offs[] = { 0, 1, 3, 4, 8, 64, 100, 127 };
+	unsigned int i, j, k, n = 0, sgs = 0, refused = 0;
+	int ret;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		for (j = 0; j < sizeof(offs) / sizeof(offs[0]); j++)
+			for (k = 0; k < sizeof(offs) / sizeof(offs[0]); k++) {
+				if (sizes[i] + 128 > WIN_SIZE)
+					continue;
+				if (copy(sizes[i], offs[j], offs[k], 1) < 0)
+					return 1;
+				n++;
+			}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		for (j = 0; j < sizeof(offs) / sizeof(offs[0]); j++) {
+			if (sizes[i] + 128 > WIN_SIZE)
+				continue;
+			if (fill(sizes[i], 0, offs[j], 1) < 0 ||
+			    fill(sizes[i], 0x5a5a5a5a, offs[j], 1) < 0)
+				return 1;
+			if ((offs[j] & 3) == 0 && fill(sizes[i] & ~3, 0x11223344, offs[j], 1) < 0)
+				return 1;
+			n++;
+		}
+
+	if (rect(200*4, 100, 480*4, 480*4, 0, (86*480 + 140)*4) < 0 ||
+	    rect(3, 5, 7, 11, 1, 2) < 0 ||
+	    rect(128, 300, 128, 256, 0, 0) < 0 ||
+	    rect(480*4, 272, 480*4, 480*4, 0, 0) < 0)
+		return 1;
+	for (i = 1; i <= 16; i++) {
+		ret = sg(i, i);
+		if (ret < 0)
+			return 1;
+		if (ret)
+			refused++;
+		else
+			sgs++;
+	}
+	if (peri(1) < 0 || peri(42) < 0 || peri(256) < 0)
+		return 1;
+	if (ring(512, 2, 5) < 0 || ring(16 * 1024, 2, 3) < 0 || ring(100, 8, 17) < 0)
+		return 1;
+
+	printf("test: %u copies and fills, 2d, %u sg lists, peri and ring ok, "
+		"%u sg lists too big for dma_copy_sg_async()\n", n, sgs, refused);
+	return 0;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr,
+		"usage: %s [-d] [-t] copy size [src_off dst_off]\n"
+		"       %s [-d] [-t] fill size value [dst_off]\n"
+		"       %s [-d] [-t] 2d width height src_stride dst_stride [src_off dst_off]\n"
+		"       %s [-d] [-t] sg count [seed]\n"
+		"       %s [-d] [-t] peri size\n"
+		"       %s [-d] [-t] ring period periods [events]\n"
+		"       %s test\n", name, name, name, name, name, name, name);
+}
+
+int main(int argc, char * argv[])
+{
+	int opt;
+	char * cmd;
+	unsigned long a[6] = {0, 0, 0, 0, 0, 0};
+	int i;
+
+	while ((opt = getopt(argc, argv, "dt")) != -1) {
+		switch (opt) {
+		case 'd':
+			dump = 1;
+			break;
+		case 't':
+			trace = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	cmd = argv[optind];
+	for (i = 0; i < 6 && optind + 1 + i < argc; i++)
+		a[i] = strtoul(argv[optind + 1 + i], NULL, 0);
+
+	if (!strcmp(cmd, "test"))
+		return test();
+	if (!strcmp(cmd, "copy") && a[0])
+		return copy(a[0], a[1], a[2], 0) < 0;
+	if (!strcmp(cmd, "fill") && a[0])
+		return fill(a[0], a[1], a[2], 0) < 0;
+	if (!strcmp(cmd, "2d") && a[3])
+		return rect(a[0], a[1], a[2], a[3], a[4], a[5]) < 0;
+	if (!strcmp(cmd, "sg") && a[0])
+		return sg(a[0], a[1]) < 0;
+	if (!strcmp(cmd, "peri") && a[0])
+		return peri(a[0]) < 0;
+	if (!strcmp(cmd, "ring") && a[1])
+		return ring(a[0], a[1], a[2] ? a[2] : 2 * a[1]) < 0;
+
+	usage(argv[0]);
+	return 1;
+}
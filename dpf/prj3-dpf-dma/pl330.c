@@ -0,0 +1,565 @@
+// PL330 program generators, see pl330.h
+
+#include "dma.h"
+#include "pl330.h"
+
+static inline int _ldst_memtomem_nobarrier(unsigned dry_run, u8 buf[],
+		const struct _xfer_spec *pxs, int cyc)
+{
+	int off = 0;
+
+	while (cyc--) {
+		off += _emit_LD(dry_run, &buf[off], ALWAYS);
+		off += _emit_ST(dry_run, &buf[off], ALWAYS);
+	}
+
+	return off;
+}
+
+static inline int _stz_mem(unsigned dry_run, u8 buf[],
+		const struct _xfer_spec *pxs, int cyc)
+{
+	int off = 0;
+
+	while (cyc--)
+		off += _emit_STZ(dry_run, &buf[off]);
+
+	return off;
+}
+
+static int _bursts(unsigned dry_run, u8 buf[],
+		const struct _xfer_spec *pxs, int cyc)
+{
+	int off = 0;
+
+#if 0
+	switch (pxs->r->rqtype) {
+	case MEMTODEV:
+		off += _ldst_memtodev(dry_run, &buf[off], pxs, cyc);
+		break;
+	case DEVTOMEM:
+		off += _ldst_devtomem(dry_run, &buf[off], pxs, cyc);
+		break;
+	case MEMTOMEM:
+		off += _ldst_memtomem(dry_run, &buf[off], pxs, cyc);
+		break;
+	case MEMTOMEM_NOBARRIER:
+		off += _ldst_memtomem_nobarrier(dry_run, &buf[off], pxs, cyc);
+		break;
+#endif
+	if (pxs->zero)
+		off += _stz_mem(dry_run, &buf[off], pxs, cyc);
+	else
+		off += _ldst_memtomem_nobarrier(dry_run, &buf[off], pxs, cyc);
+
+	return off;
+}
+
+
+/* Returns bytes consumed and updates bursts */
+static inline int _loop(unsigned dry_run, u8 buf[],
+		unsigned long *bursts, 
+		const struct _xfer_spec *pxs)		
+{
+	int cyc, cycmax, szlp, szlpend, off;
+	unsigned lcnt0, lcnt1, ljmp0, ljmp1;
+	struct _arg_LPEND lpend;
+
+	/* Max iterations possibile in DMALP is 256 */
+	if (*bursts >= 256*256) {
+		lcnt1 = 256;
+		lcnt0 = 256;
+		//cyc = *bursts / lcnt1 / lcnt0;
+		cyc = *bursts / 256 / 256;
+	} else if (*bursts > 256) {
+		lcnt1 = 256;
+		//lcnt0 = *bursts / lcnt1;
+		lcnt0 = *bursts / 256;
+		cyc = 1;
+	} else {
+		lcnt1 = *bursts;
+		lcnt0 = 0;
+		cyc = 1;
+	}
+
+	szlp = _emit_LP(1, buf, 0, 0);
+
+	lpend.cond = ALWAYS;
+	lpend.forever = false;
+	lpend.loop = 0;
+	lpend.bjump = 0;
+	szlpend = _emit_LPEND(1, buf, &lpend);
+
+	if (lcnt0) {
+		szlp *= 2;
+		szlpend *= 2;
+	}
+
+	/*
+	 * Max bursts that we can unroll due to limit on the
+	 * size of backward jump that can be encoded in DMALPEND
+	 * which is 8-bits and hence 255
+	 */
+	//cycmax = (255 - (szlp + szlpend)) / szbrst;
+	// DMALP: 2bytes    DMALPEND: 2bytes
+	// one burst: DMALD: 1byte + DMAST: 1byte
+	cycmax = (255 - (2*2 + 2*2)) / 2;
+
+	cyc = (cycmax < cyc) ? cycmax : cyc;
+
+	off = 0;
+
+	if (lcnt0) {
+		off += _emit_LP(dry_run, &buf[off], 0, lcnt0);
+		ljmp0 = off;
+	}
+
+	off += _emit_LP(dry_run, &buf[off], 1, lcnt1);
+	ljmp1 = off;
+
+	off += _bursts(dry_run, &buf[off], pxs, cyc);
+
+	lpend.cond = ALWAYS;
+	lpend.forever = false;
+	lpend.loop = 1;
+	lpend.bjump = off - ljmp1;
+	off += _emit_LPEND(dry_run, &buf[off], &lpend);
+
+	if (lcnt0) {
+		lpend.cond = ALWAYS;
+		lpend.forever = false;
+		lpend.loop = 0;
+		lpend.bjump = off - ljmp0;
+		off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	}
+
+	*bursts = lcnt1 * cyc;
+	if (lcnt0)
+		*bursts *= lcnt0;
+
+	return off;
+}
+
+static inline int _setup_loops(unsigned dry_run, u8 buf[],
+		const struct _xfer_spec *pxs)
+{
+	//struct pl330_xfer *x = pxs->x;
+	//u32 ccr = pxs->ccr;
+	unsigned long c, bursts = pxs->size;		// BYTE_TO_BURST(x->bytes, ccr);
+	int off = 0;
+
+	while (bursts) {
+		c = bursts;
+		off += _loop(dry_run, &buf[off], &c, pxs);		
+		bursts -= c;
+	}
+
+	return off;
+}
+
+/*
+ * Burst copy: SRCBRSTSIZE/DSTBRSTSIZE = 3 and BRSTLEN = 16 move 128 bytes
+ * per DMALD/DMAST instead of 1. The head and tail that do not fill a whole
+ * burst are moved with single beats, then with bytes.
+ */
+#define DMA_MAX_BRSTSIZE	3	// 8 bytes, the AXI data width of DMA_MEM
+#define DMA_MAX_BRSTLEN		16
+#define DMA_MAX_BRSTLEN_SHIFT	4	// log2 of DMA_MAX_BRSTLEN
+
+static inline u32 _mem_ccr(unsigned brst_size, unsigned brst_len)
+{
+	u32 ccr = 0;
+
+	ccr |= CC_SRCINC;
+	ccr |= CC_DSTINC;
+
+	ccr |= (brst_size << CC_SRCBRSTSIZE_SHFT);
+	ccr |= (brst_size << CC_DSTBRSTSIZE_SHFT);
+
+	ccr |= (((brst_len - 1) & 0xf) << CC_SRCBRSTLEN_SHFT);
+	ccr |= (((brst_len - 1) & 0xf) << CC_DSTBRSTLEN_SHFT);
+
+	ccr |= (1 << CC_SRCCCTRL_SHFT);
+	ccr |= (1 << CC_DSTCCTRL_SHFT);
+
+	return ccr;
+}
+
+/* DMAMOV CCR + loops of cnt LD/ST pairs, nothing if cnt is 0 */
+static int _segment_z(unsigned dry_run, u8 buf[], u32 ccr, u32 cnt, int zero)
+{
+	struct _xfer_spec xs;
+	int off = 0;
+
+	if (cnt == 0)
+		return 0;
+
+	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
+
+	xs.ccr = ccr;
+	xs.size = cnt;
+	xs.zero = zero;
+	off += _setup_loops(dry_run, &buf[off], &xs);
+
+	return off;
+}
+
+static int _segment(unsigned dry_run, u8 buf[], u32 ccr, u32 cnt)
+{
+	return _segment_z(dry_run, buf, ccr, cnt, 0);
+}
+
+/*
+ * Program of a src -> dst copy, without DMASEV/DMAEND.
+ * The beat size is the largest both addresses share the alignment of, the
+ * burst length the largest that keeps bursts at a multiple of beat * len in
+ * both src and dst, so no burst crosses a 4KB boundary.
+ * ns makes the accesses non-secure, for a thread of DMA_peri.
+ */
+int pl330_copy_prog(unsigned dry_run, u8 buf[], u32 src, u32 dst, u32 size, int ns)
+{
+	u32 nsf = ns ? CC_SRCNS | CC_DSTNS : 0;
+	u32 diff = src ^ dst;
+	unsigned bs = DMA_MAX_BRSTSIZE;
+	unsigned lb = 4;		// log2(DMA_MAX_BRSTLEN)
+	u32 beat, burst, n;
+	int off = 0;
+
+	while (bs && (diff & ((1 << bs) - 1)))
+		bs--;
+	while (lb && (diff & ((1 << (bs + lb)) - 1)))
+		lb--;
+	beat = 1 << bs;
+	burst = 1 << (bs + lb);
+
+	off += _emit_MOV(dry_run, &buf[off], SAR, src);
+	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+
+	/* head: bytes up to a beat boundary */
+	n = (beat - (src & (beat - 1))) & (beat - 1);
+	if (n > size)
+		n = size;
+	off += _segment(dry_run, &buf[off], _mem_ccr(0, 1) | nsf, n);
+	src += n;
+	size -= n;
+
+	/* head: beats up to a burst boundary */
+	n = ((burst - (src & (burst - 1))) & (burst - 1)) >> bs;
+	if (n > (size >> bs))
+		n = size >> bs;
+	off += _segment(dry_run, &buf[off], _mem_ccr(bs, 1) | nsf, n);
+	src += n << bs;
+	size -= n << bs;
+
+	/* middle: whole bursts */
+	n = size >> (bs + lb);
+	off += _segment(dry_run, &buf[off], _mem_ccr(bs, 1 << lb) | nsf, n);
+	size -= n << (bs + lb);
+
+	/* tail: beats, then bytes */
+	n = size >> bs;
+	off += _segment(dry_run, &buf[off], _mem_ccr(bs, 1) | nsf, n);
+	size -= n << bs;
+
+	off += _segment(dry_run, &buf[off], _mem_ccr(0, 1) | nsf, size);
+
+	return off;
+}
+
+/*
+ * Program filling size bytes at dst: DMALD of the 8-byte pattern at pat
+ * with a fixed source address, DMAST to dst incrementing, or DMASTZ alone
+ * if zero. Bytes up to a word, a word up to 8 bytes, beats up to a burst
+ * boundary of dst, then bursts and the same steps backwards. The byte
+ * steps repeat the first pattern byte, so a 32-bit pattern needs dst and
+ * size in words.
+ */
+int pl330_fill_prog(unsigned dry_run, u8 buf[], u32 pat, u32 dst, u32 size, int zero)
+{
+	unsigned bs = DMA_MAX_BRSTSIZE;
+	u32 beat = 1 << bs, burst = beat * DMA_MAX_BRSTLEN;
+	u32 ccr, n;
+	int off = 0;
+
+	off += _emit_MOV(dry_run, &buf[off], SAR, pat);
+	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+
+	/* head: bytes, a word */
+	n = (4 - (dst & 3)) & 3;
+	if (n > size)
+		n = size;
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(0, 1) & ~CC_SRCINC, n, zero);
+	dst += n;
+	size -= n;
+
+	n = (dst & 4) && size >= 4;
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(2, 1) & ~CC_SRCINC, n, zero);
+	dst += n << 2;
+	size -= n << 2;
+
+	/* head: beats up to a burst boundary */
+	n = ((burst - (dst & (burst - 1))) & (burst - 1)) >> bs;
+	if (n > (size >> bs))
+		n = size >> bs;
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(bs, 1) & ~CC_SRCINC, n, zero);
+	size -= n << bs;
+
+	/* middle: whole bursts */
+	ccr = _mem_ccr(bs, DMA_MAX_BRSTLEN) & ~CC_SRCINC;
+	n = size >> (bs + DMA_MAX_BRSTLEN_SHIFT);	// no divide, there is no libgcc
+	off += _segment_z(dry_run, &buf[off], ccr, n, zero);
+	size -= n << (bs + DMA_MAX_BRSTLEN_SHIFT);
+
+	/* tail: beats, a word, bytes */
+	n = size >> bs;
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(bs, 1) & ~CC_SRCINC, n, zero);
+	size -= n << bs;
+
+	n = size >> 2;
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(2, 1) & ~CC_SRCINC, n, zero);
+	size -= n << 2;
+
+	off += _segment_z(dry_run, &buf[off], _mem_ccr(0, 1) & ~CC_SRCINC, size, zero);
+
+	return off;
+}
+
+/* end of every program: writes done, then the completion event of thread ev */
+int pl330_tail(unsigned dry_run, u8 buf[], u8 ev)
+{
+	int off = 0;
+
+	off += _emit_WMB(dry_run, &buf[off]);
+	off += _emit_SEV(dry_run, &buf[off], ev);
+	off += _emit_END(dry_run, &buf[off]);
+
+	return off;
+}
+
+/* bursts of one row, lc1 loops of up to 256 */
+static int _row(unsigned dry_run, u8 buf[], u32 n)
+{
+	struct _arg_LPEND lpend;
+	int off = 0, ljmp;
+	u32 c;
+
+	for (; n; n -= c) {
+		c = n > 256 ? 256 : n;
+		if (c == 1) {
+			off += _emit_LD(dry_run, &buf[off], ALWAYS);
+			off += _emit_ST(dry_run, &buf[off], ALWAYS);
+			continue;
+		}
+
+		off += _emit_LP(dry_run, &buf[off], 1, c);
+		ljmp = off;
+		off += _emit_LD(dry_run, &buf[off], ALWAYS);
+		off += _emit_ST(dry_run, &buf[off], ALWAYS);
+
+		lpend.cond = ALWAYS;
+		lpend.forever = false;
+		lpend.loop = 1;
+		lpend.bjump = off - ljmp;
+		off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	}
+
+	return off;
+}
+
+/*
+ * Program of a width x height window: lc0 runs the rows (256 at a time), the
+ * row is lc1 loops of bursts and DMAADDH steps SAR/DAR over the rest of the
+ * stride. Beat and burst size follow the alignment that addresses, strides
+ * and width share, so every row is whole bursts. -1 if a row does not fit
+ * the 8-bit backward jump of DMALPEND.
+ */
+int pl330_rect_prog(unsigned dry_run, u8 buf[], u32 src, u32 src_stride,
+		u32 dst, u32 dst_stride, u32 width, u32 height)
+{
+	u32 align = src | dst | src_stride | dst_stride | width;
+	unsigned bs = DMA_MAX_BRSTSIZE;
+	unsigned lb = 4;		// log2(DMA_MAX_BRSTLEN)
+	struct _arg_LPEND lpend;
+	u32 n, h, rows;
+	int off = 0, ljmp;
+
+	while (bs && (align & ((1 << bs) - 1)))
+		bs--;
+	while (lb && (align & ((1 << (bs + lb)) - 1)))
+		lb--;
+	n = width >> (bs + lb);
+
+	if (_row(1, buf, n) + 2 * SZ_DMAADDH > 255)
+		return -1;
+
+	off += _emit_MOV(dry_run, &buf[off], SAR, src);
+	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+	off += _emit_MOV(dry_run, &buf[off], CCR, _mem_ccr(bs, 1 << lb));
+
+	for (h = height; h; h -= rows) {
+		rows = h > 256 ? 256 : h;
+
+		off += _emit_LP(dry_run, &buf[off], 0, rows);
+		ljmp = off;
+
+		off += _row(dry_run, &buf[off], n);
+		if (src_stride != width)
+			off += _emit_ADDH(dry_run, &buf[off], SRC, src_stride - width);
+		if (dst_stride != width)
+			off += _emit_ADDH(dry_run, &buf[off], DST, dst_stride - width);
+
+		lpend.cond = ALWAYS;
+		lpend.forever = false;
+		lpend.loop = 0;
+		lpend.bjump = off - ljmp;
+		off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	}
+
+	return off;
+}
+
+/* one _copy_prog per entry, each starts with its own DMAMOV SAR/DAR */
+int pl330_sg_prog(unsigned dry_run, u8 buf[], const struct dma_sg * sg, int n)
+{
+	int off = 0, i;
+
+	for (i = 0; i < n; i++)
+		if (sg[i].size > 0)
+			off += pl330_copy_prog(dry_run, &buf[off], sg[i].src, sg[i].dst, sg[i].size, 0);
+
+	return off;
+}
+
+/*
+ * size (<= 256) single transfers src -> peri at dst, the way UART0_TX is fed.
+ * *sar / *dar get the offsets of the DMAMOV SAR/DAR for patching.
+ */
+int pl330_peri_prog(unsigned dry_run, u8 buf[], u32 src, u32 dst, u8 peri, int size,
+		u8 ev, int * sar, int * dar)
+{
+	u32 ccr = 0;
+	int off;
+	int ljmp;
+	struct _arg_LPEND lpend;
+
+	ccr |= CC_SRCINC;
+//	ccr |= CC_DSTINC;
+
+	//if (rqc->nonsecure)
+		ccr |= CC_SRCNS | CC_DSTNS;		// DMA_peri must be non-secure
+
+	ccr |= (0 << CC_SRCBRSTSIZE_SHFT);
+	ccr |= (0 << CC_DSTBRSTSIZE_SHFT);
+	
+	ccr |= (((1 - 1) & 0xf) << CC_SRCBRSTLEN_SHFT);
+	ccr |= (((1 - 1) & 0xf) << CC_DSTBRSTLEN_SHFT);
+
+	ccr |= (1 << CC_SRCCCTRL_SHFT);
+	ccr |= (1 << CC_DSTCCTRL_SHFT);
+
+	off = 0;
+
+	PL330_DBGMC_START(off);
+
+	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
+	off += _emit_FLUSHP(dry_run, &buf[off], peri);
+
+	*sar = off;
+	off += _emit_MOV(dry_run, &buf[off], SAR, src);
+	*dar = off;
+	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+
+	off += _emit_LP(dry_run, &buf[off], 0,  size);
+	ljmp = off;
+
+	off += _emit_WFP(dry_run, &buf[off], SINGLE, peri);
+	off += _emit_LD(dry_run, &buf[off], ALWAYS);
+	off += _emit_STP(dry_run, &buf[off], SINGLE, peri);	// UART0_TX = 1
+	off += _emit_FLUSHP(dry_run, &buf[off], peri);
+	
+	lpend.cond = SINGLE;
+	lpend.forever = 0;
+	lpend.loop = 0;		// lc0
+	lpend.bjump = off - ljmp;
+	off += _emit_LPEND(dry_run, &buf[off], &lpend);
+
+	off +=_emit_SEV(dry_run, &buf[off], ev);
+	off += _emit_END(dry_run, &buf[off]);
+
+	return off;
+}
+
+/*
+ * Memory -> peripheral ring of periods x period bytes at ring, one 16-bit
+ * beat per peripheral request. The program loops forever (DMALPFE) and
+ * raises event ev after every period. -1 if the period can not be counted
+ * with lc0 x lc1 or the ring does not fit the 255-byte DMALPFE jump.
+ */
+int pl330_ring_prog(unsigned dry_run, u8 buf[], u32 ring, int period, int periods,
+		u32 dst, u8 peri, u8 ev)
+{
+	u32 ccr = 0;
+	struct _arg_LPEND lpend;
+	int off, lpfe, ljmp0 = 0, ljmp1, beats, i;
+
+	beats = period >> 1;
+	if (period <= 0 || period & 1 || (beats > 256 && (beats & 0xff)) || beats > 256*256)
+		return -1;
+	if (periods < 1 || periods > 8)
+		return -1;
+
+	ccr |= CC_SRCINC;
+	ccr |= CC_SRCNS | CC_DSTNS;		// DMA_peri must be non-secure
+	ccr |= (1 << CC_SRCBRSTSIZE_SHFT);	// halfword, one sample
+	ccr |= (1 << CC_DSTBRSTSIZE_SHFT);
+	ccr |= (1 << CC_SRCCCTRL_SHFT);
+	ccr |= (1 << CC_DSTCCTRL_SHFT);
+
+	off = 0;
+
+	PL330_DBGMC_START(off);
+
+	off += _emit_MOV(dry_run, &buf[off], CCR, ccr);
+	off += _emit_FLUSHP(dry_run, &buf[off], peri);
+	off += _emit_MOV(dry_run, &buf[off], DAR, dst);
+
+	lpfe = off;
+	off += _emit_MOV(dry_run, &buf[off], SAR, ring);
+
+	for (i = 0; i < periods; i++) {
+		if (beats > 256) {
+			off += _emit_LP(dry_run, &buf[off], 0, beats >> 8);
+			ljmp0 = off;
+		}
+		off += _emit_LP(dry_run, &buf[off], 1, beats > 256 ? 256 : beats);
+		ljmp1 = off;
+
+		off += _emit_WFP(dry_run, &buf[off], SINGLE, peri);
+		off += _emit_LD(dry_run, &buf[off], ALWAYS);
+		off += _emit_STP(dry_run, &buf[off], SINGLE, peri);
+		off += _emit_FLUSHP(dry_run, &buf[off], peri);
+
+		lpend.cond = ALWAYS;
+		lpend.forever = false;
+		lpend.loop = 1;
+		lpend.bjump = off - ljmp1;
+		off += _emit_LPEND(dry_run, &buf[off], &lpend);
+
+		if (beats > 256) {
+			lpend.loop = 0;
+			lpend.bjump = off - ljmp0;
+			off += _emit_LPEND(dry_run, &buf[off], &lpend);
+		}
+
+		off += _emit_SEV(dry_run, &buf[off], ev);
+	}
+
+	lpend.cond = ALWAYS;
+	lpend.forever = true;
+	lpend.loop = 0;
+	lpend.bjump = off - lpfe;
+	off += _emit_LPEND(dry_run, &buf[off], &lpend);
+	off += _emit_END(dry_run, &buf[off]);
+
+	return off;
+}
@@ -1,10 +1,13 @@
 #include "stdio.h"
+#include "uart.h"
+
+#include <stdarg.h>		// gcc's own, no libc behind it
 
 void putchar_hex(char c)
 {
 	char * hex = "0123456789ABCDEF";	// good
 	//char hex[] = "0123456789ABCDEF";	bad!
-	
+
 	putchar(hex[(c & 0xf0)>>4]);
 	putchar(hex[(c & 0x0f)>>0]);
 	//putchar(' ');
@@ -18,121 +21,305 @@ void putint_hex(int a)
 	putchar_hex( (a>>0) & 0xFF );
 }
 
-char * itoa(int a, char * buf)
+// n / 10 = n * 0xCCCCCCCD >> 35, exact for every 32-bit n; no divide
+// instruction and no libgcc, umull keeps it at one multiply
+static inline unsigned int _div10(unsigned int n)
 {
-	int num = a;
-	int i = 0;
-	int len = 0;
-	
-	do 
-	{
-		buf[i++] = num % 10 + '0';
-		num /= 10;		
-	} while (num);
-	buf[i] = '\0';
-	
-	len = i;
-	for (i = 0; i < len/2; i++)
-	{
-		char tmp;
-		tmp = buf[i];
-		buf[i] = buf[len-i-1];
-		buf[len-i-1] = tmp;
-	}
-	
-	return buf;	
+	unsigned int lo, hi;
+
+	__asm__("umull %0, %1, %2, %3" : "=&r" (lo), "=&r" (hi) : "r" (n), "r" (0xCCCCCCCD));
+
+	return hi >> 3;
 }
 
-#if 0
-#include <stdarg.h>
-#else
-typedef int * va_list;
-#define va_start(ap, A)		(ap = (int *)&(A) + 1)
-#define va_arg(ap, T)		(*(T *)ap++)
-#define va_end(ap)		((void)0)
-#endif
+// where formatted characters go: buf, emptied by flush when full,
+// or cut at size when there is no flush (snprintf)
+struct _out {
+	char * buf;
+	int size;
+	int len;		// in buf now
+	int total;		// formatted so far
+	void (*flush)(struct _out * o);
+};
 
-static int _puts(const char * s)
+static void _putc(struct _out * o, char c)
 {
-	while (*s)
-		putchar(*s++);
-		
-//	putchar('\n');
+	if (o->len == o->size && o->flush)
+		o->flush(o);
+	if (o->len < o->size)
+		o->buf[o->len++] = c;
+	o->total++;
+}
 
-	return 0;
+static void _pad(struct _out * o, char c, int n)
+{
+	while (n-- > 0)
+		_putc(o, c);
 }
 
-int printf(const char * format, ...)
+#define F_LEFT		(1 << 0)	// -
+#define F_ZERO		(1 << 1)	// 0
+#define F_PLUS		(1 << 2)	// +
+#define F_SPACE		(1 << 3)	// ' '
+#define F_ALT		(1 << 4)	// #
+#define F_UPPER		(1 << 5)	// %X
+
+// digits of v (base 10 or 16) with sign, precision and width
+static void _number(struct _out * o, unsigned int v, int base, int neg,
+		int flags, int width, int prec)
 {
-	char c;	
-	va_list ap;
-		
-	va_start(ap, format);
-	
-	while ((c = *format++) != '\0')
+	const char * digits = (flags & F_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+	char tmp[12], prefix[2];
+	int n = 0, np = 0, alt = 0, zeros, q;
+
+	// 0x in front of anything but 0
+	if ((flags & F_ALT) && base == 16 && v)
+		alt = 2;
+
+	while (v)
 	{
-		switch (c)
+		if (base == 16)
 		{
-			case '%':
-				c = *format++;
-				
-				switch (c)
+			tmp[n++] = digits[v & 0xf];
+			v >>= 4;
+		}
+		else
+		{
+			q = _div10(v);
+			tmp[n++] = '0' + (v - q * 10);
+			v = q;
+		}
+	}
+	// "%.0d" of 0 prints nothing
+	if (n == 0 && prec != 0)
+		tmp[n++] = '0';
+
+	if (neg)
+		prefix[np++] = '-';
+	else if (flags & F_PLUS)
+		prefix[np++] = '+';
+	else if (flags & F_SPACE)
+		prefix[np++] = ' ';
+	zeros = prec > n ? prec - n : 0;
+	if (prec < 0 && (flags & F_ZERO) && !(flags & F_LEFT))
+		zeros = width - np - alt - n;
+	if (zeros < 0)
+		zeros = 0;
+	width -= np + alt + zeros + n;
+
+	if (!(flags & F_LEFT))
+		_pad(o, ' ', width);
+	for (q = 0; q < np; q++)
+		_putc(o, prefix[q]);
+	if (alt)
+	{
+		_putc(o, '0');
+		_putc(o, (flags & F_UPPER) ? 'X' : 'x');
+	}
+	_pad(o, '0', zeros);
+	while (n)
+		_putc(o, tmp[--n]);
+	if (flags & F_LEFT)
+		_pad(o, ' ', width);
+}
+
+/*
+ * %[flags][width][.precision][length]conversion
+ * flags - 0 + ' ' #, width and precision a number or *, length h l (int and
+ * long are both 32 bits), conversions c s d i u x X p %
+ */
+static int _format(struct _out * o, const char * fmt, va_list ap)
+{
+	const char * s;
+	int flags, width, prec, len, d;
+	unsigned int u;
+	char c;
+
+	while ((c = *fmt++) != '\0')
+	{
+		if (c != '%')
+		{
+			_putc(o, c);
+			continue;
+		}
+
+		flags = 0;
+		for (;;)
+		{
+			c = *fmt++;
+			if (c == '-')
+				flags |= F_LEFT;
+			else if (c == '0')
+				flags |= F_ZERO;
+			else if (c == '+')
+				flags |= F_PLUS;
+			else if (c == ' ')
+				flags |= F_SPACE;
+			else if (c == '#')
+				flags |= F_ALT;
+			else
+				break;
+		}
+
+		width = 0;
+		if (c == '*')
+		{
+			width = va_arg(ap, int);
+			if (width < 0)
+			{
+				flags |= F_LEFT;
+				width = -width;
+			}
+			c = *fmt++;
+		}
+		else
+			while (c >= '0' && c <= '9')
+			{
+				width = width * 10 + c - '0';
+				c = *fmt++;
+			}
+
+		prec = -1;
+		if (c == '.')
+		{
+			prec = 0;
+			c = *fmt++;
+			if (c == '*')
+			{
+				prec = va_arg(ap, int);
+				c = *fmt++;
+			}
+			else
+				while (c >= '0' && c <= '9')
 				{
-					char ch;
-					char * p;
-					int a;
-					char buf[100];
-									
-					case 'c':
-						ch = va_arg(ap, int);
-						putchar(ch);
-						break;
-					case 's':
-						p = va_arg(ap, char *);
-						_puts(p);
-						break;					
-					case 'x':
-						a = va_arg(ap, int);
-						putint_hex(a);
-						break;		
-					case 'd':
-						a = va_arg(ap, int);
-						itoa(a, buf);
-						_puts(buf);
-						break;	
-					case 'l':	// support %ld
-						c = *format++;
-						a = va_arg(ap, int);
-						itoa(a, buf);
-						_puts(buf);
-						break;	
-					
-					default:
-						break;
-				}				
-				break;		
+					prec = prec * 10 + c - '0';
+					c = *fmt++;
+				}
+		}
 
+		while (c == 'l' || c == 'h')
+			c = *fmt++;
+
+		switch (c)
+		{
+			case 'c':
+				if (!(flags & F_LEFT))
+					_pad(o, ' ', width - 1);
+				_putc(o, (char)va_arg(ap, int));
+				if (flags & F_LEFT)
+					_pad(o, ' ', width - 1);
+				break;
+			case 's':
+				s = va_arg(ap, const char *);
+				if (!s)
+					s = "(null)";
+				for (len = 0; s[len] && (prec < 0 || len < prec); len++)
+					;
+				if (!(flags & F_LEFT))
+					_pad(o, ' ', width - len);
+				for (d = 0; d < len; d++)
+					_putc(o, s[d]);
+				if (flags & F_LEFT)
+					_pad(o, ' ', width - len);
+				break;
+			case 'd':
+			case 'i':
+				d = va_arg(ap, int);
+				u = d < 0 ? -(unsigned int)d : (unsigned int)d;
+				_number(o, u, 10, d < 0, flags, width, prec);
+				break;
+			case 'u':
+				_number(o, va_arg(ap, unsigned int), 10, 0, flags, width, prec);
+				break;
+			case 'X':
+				flags |= F_UPPER;
+				// fall through
+			case 'x':
+				_number(o, va_arg(ap, unsigned int), 16, 0, flags, width, prec);
+				break;
+			case 'p':
+				_number(o, (unsigned int)va_arg(ap, void *), 16, 0,
+					flags | F_ALT, width, 8);
+				break;
+			case '%':
+				_putc(o, '%');
+				break;
+			case '\0':
+				fmt--;
+				break;
 			default:
-				putchar(c);
+				_putc(o, '%');
+				_putc(o, c);
 				break;
 		}
 	}
-	
-	return 0;	
+
+	return o->total;
+}
+
+int vsnprintf(char * buf, int size, const char * format, va_list ap)
+{
+	struct _out o;
+
+	o.buf = buf;
+	o.size = size > 0 ? size - 1 : 0;	// room for the '\0'
+	o.len = 0;
+	o.total = 0;
+	o.flush = 0;
+
+	_format(&o, format, ap);
+	if (size > 0)
+		buf[o.len] = '\0';
+
+	return o.total;
 }
 
-#if 0
-	// get the stack address
-	int addr = (int)&format;
-	char * sp = (char *)addr;
-	int i;
-	
-	putint_hex(addr);	// 0xF50 stack address
-	
-	// get the format string address
-//	addr = (int)format;
-//	putint_hex(addr);	// 0x110 bin rodata address
-
-	for (i = 0; i < 30; i++)
-		putchar_hex(*(sp+i));
-#endif
+int snprintf(char * buf, int size, const char * format, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, format);
+	n = vsnprintf(buf, size, format, ap);
+	va_end(ap);
+
+	return n;
+}
+
+// printf formats into this and hands it to the UART in one piece
+#define PRINTF_BUF_SIZE		256
+
+// uart_write() takes what fits in the tx ring; when it is full, help it
+// drain, the irq may be off
+static void _uart_flush(struct _out * o)
+{
+	int n = 0;
+
+	while (n < o->len)
+	{
+		n += uart_write(o->buf + n, o->len - n);
+		if (n < o->len)
+			uart_poll();
+	}
+	o->len = 0;
+}
+
+int printf(const char * format, ...)
+{
+	char buf[PRINTF_BUF_SIZE];
+	struct _out o;
+	va_list ap;
+
+	o.buf = buf;
+	o.size = PRINTF_BUF_SIZE;
+	o.len = 0;
+	o.total = 0;
+	o.flush = _uart_flush;
+
+	va_start(ap, format);
+	_format(&o, format, ap);
+	va_end(ap);
+	_uart_flush(&o);
+
+	return o.total;
+}
@@ -0,0 +1,95 @@
+
+#include "stdio.h"
+#include "vic.h"
+#include "prof.h"
+
+// Timer 1, the prescaler 0 it shares with timer 0 is 65 as in timer.c
+#define TCFG0		(*(volatile unsigned int *)0xE2500000)
+#define TCFG1		(*(volatile unsigned int *)0xE2500004)
+#define TCON		(*(volatile unsigned int *)0xE2500008)
+#define TCNTB1		(*(volatile unsigned int *)0xE2500018)
+#define TINT_CSTAT	(*(volatile unsigned int *)0xE2500044)
+
+// ld's default script provides these
+extern char _start[], _etext[];
+
+static unsigned int prof_hist[PROF_BUCKETS];
+static unsigned int prof_base;
+static unsigned int prof_shift;
+static unsigned int prof_samples;
+static unsigned int prof_other;		// outside .text
+static int prof_on;
+
+// VIC0[22], see vic.c
+static void timer1_irq(void * ctx)
+{
+	unsigned int b = (irq_pc() - prof_base) >> prof_shift;
+
+	// [9:5] are cleared by writing 1, clear only timer 1's
+	TINT_CSTAT = (TINT_CSTAT & 0x1f) | (1 << 6);
+
+	if (b < PROF_BUCKETS)
+		prof_hist[b]++;
+	else
+		prof_other++;
+	prof_samples++;
+}
+
+void prof_start(void)
+{
+	unsigned int size = _etext - _start;
+	int i;
+
+	if (prof_on)
+		prof_stop();
+
+	for (i = 0; i < PROF_BUCKETS; i++)
+		prof_hist[i] = 0;
+	prof_samples = 0;
+	prof_other = 0;
+	prof_base = (unsigned int)_start;
+	for (prof_shift = 2; (size >> prof_shift) >= PROF_BUCKETS; prof_shift++)
+		;
+
+	// PCLK / (65+1) = 1M, timer 1 divider 1/1
+	TCFG0 = (TCFG0 & ~0xff) | 65;
+	TCFG1 = (TCFG1 & ~(0xf << 4)) | (0x0 << 4);
+	TCNTB1 = PROF_PERIOD_US - 1;
+
+	// TCON timer 1: [8] start, [9] manual update, [11] auto-reload
+	TCON = (TCON & ~(0xf << 8)) | (1 << 9);
+	TCON = (TCON & ~(0xf << 8)) | (1 << 11) | (1 << 8);
+	TINT_CSTAT = (TINT_CSTAT & 0x1f) | (1 << 1);
+
+	// above everything, so it also samples the other handlers with irq_nesting
+	irq_register(INT_TIMER1, timer1_irq, 0, 0);
+	prof_on = 1;
+}
+
+void prof_stop(void)
+{
+	if (!prof_on)
+		return;
+
+	irq_unregister(INT_TIMER1);
+	TINT_CSTAT = TINT_CSTAT & 0x1f & ~(1 << 1);
+	TCON &= ~(1 << 8);
+	prof_on = 0;
+}
+
+int prof_running(void)
+{
+	return prof_on;
+}
+
+void prof_dump(void)
+{
+	int i;
+
+	printf("prof: %u samples every %u us, %u outside .text, %u bytes a bucket\n",
+		prof_samples, PROF_PERIOD_US, prof_other, 1 << prof_shift);
+	for (i = 0; i < PROF_BUCKETS; i++)
+		if (prof_hist[i])
+			printf("PROF %08x %u\n", prof_base + (i << prof_shift), prof_hist[i]);
+	puts("prof: end");
+}
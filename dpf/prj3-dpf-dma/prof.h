@@ -0,0 +1,17 @@
+
+// Statistical profiler: PWM timer 1 interrupts every PROF_PERIOD_US and
+// counts the pc it interrupted (irq_pc(), vic.h) in a histogram over
+// .text. Code that runs with irqs off is only sampled once it turns them
+// back on. prof_dump() prints the histogram as text; prof-decode/ turns a
+// capture of it into a flat profile by function.
+
+#define PROF_PERIOD_US	997		// not a multiple of the 1ms jiffy of timer.c
+#define PROF_BUCKETS	16384		// .text / PROF_BUCKETS rounded up to 2^n bytes a bucket
+
+// clears the histogram and starts sampling
+void prof_start(void);
+void prof_stop(void);
+int prof_running(void);
+
+// "PROF address count" for every bucket hit, between a header and "prof: end"
+void prof_dump(void);
@@ -1,13 +1,12 @@
 #include "sdhc.h"
 #include "uart.h"
 #include "stdio.h"
+#include "ticks.h"
+#include "mmu.h"
+#include "trace.h"
 
 //#define	debug		printf
-
-static int debug(const char * fmt, ...)
-{
-	return 0;
-}
+#define	debug		TRACE
 
 typedef enum _SDHC_REGS {
 	SDHC_SYS_ADDR						= 0x00,
@@ -234,14 +233,13 @@ SDHC SDHC_descriptor;
 //////////
 // File Name : SDHC_INT_WAIT_CLEAR (Inline Macro)
 // File Description : Interrupt wait and clear.
-// Input : SDHC, interrupt bit, timeout loop count 
-// Output : NONE.	// 0x7F000000 youngbo.song
+// Input : SDHC, interrupt bit, set to 0 on timeout
+// Output : NONE.	// SDHC_INT_TIMEOUT_US of get_ticks(), was a 0x7F000000 loop count
 #define SDHC_INT_WAIT_CLEAR(sCh,bit,loop) \
-	loop=0x7F000000; \
-	while ( !(SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) ) ) { \
-		if ( --loop == 0 ) { \
-			/*CONSOL_Printf( "***********Time out Error : bit : %d, Line:%d \n", bit, __LINE__ ); */\
-			break;	} } \
+	{ unsigned long long _uTimeout = timeout_start(SDHC_INT_TIMEOUT_US); \
+	loop=1; \
+	while ( loop && !(SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) ) ) \
+		loop = !timeout_expired(_uTimeout); } \
 	do { SDOutp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT, (1<<bit) ); \
 	} while( SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) );
 
@@ -266,6 +264,21 @@ SDHC SDHC_descriptor;
 	SDOutp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT, (1<<bit) ); \
 	while( SDInp16( (sCh)->m_uBaseAddr + SDHC_NORMAL_INT_STAT ) & (1<<bit) );
 
+// command / transfer / buffer ready, and the clock stable bits
+#define SDHC_INT_TIMEOUT_US	1000000
+#define SDHC_CLK_TIMEOUT_US	10000
+
+//////////
+// File Name : SDHC_WaitClock
+// File Description : Wait for a stable bit of CLK_CTRL.
+// Input : SDHC, bit mask
+// Output : NONE.	// gives up after SDHC_CLK_TIMEOUT_US
+static void SDHC_WaitClock(SDHC* sCh, U16 uMask) {
+	unsigned long long uTimeout = timeout_start(SDHC_CLK_TIMEOUT_US);
+
+	while ( !( SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ) & uMask ) && !timeout_expired(uTimeout) );
+}
+
 //
 // [7:6] Command Type
 // [5]  Data Present Select
@@ -824,6 +837,7 @@ U8 SDHC_ReadBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr)
 	SDHC_SetBlockCountReg(sCh, uBlocks); // Block Numbers to Write
 
 	if ( sCh->m_eOpMode == SDHC_SDMA_MODE ) {
+		cache_inv_range(uBufAddr, uBlocks * 512);	// the controller writes SDRAM
 		SDHC_SetSystemAddressReg(sCh, uBufAddr);// AHB System Address For Write
 		SDHC_SetTransferModeReg((uBlocks==1)?(0):(1), 1, (uBlocks==1)?(0):(1), 1, 1, sCh ); //Transfer mode setting
 	}
@@ -883,6 +897,7 @@ U8 SDHC_WriteBlocks(U32 uStBlock, U16 uBlocks, U32 uBufAddr) {
 	SDHC_SetBlockSizeReg(sCh, 7, 512); // Maximum DMA Buffer Size, Block Size
 	SDHC_SetBlockCountReg(sCh, uBlocks); // Block Numbers to Write 
 	if( sCh->m_eOpMode == SDHC_SDMA_MODE ) {
+		cache_clean_range(uBufAddr, uBlocks * 512);	// the controller reads SDRAM
 		SDHC_SetSystemAddressReg(sCh, uBufAddr);// AHB System Address For Write
 		SDHC_SetTransferModeReg( (uBlocks==1)?(0):(1), 0, (uBlocks==1)?(0):(1), 1, 1, sCh ); // transfer mode 
 	}
@@ -1071,7 +1086,7 @@ void SDHC_SetSdClockOnOff(U8 uOnOff, SDHC* sCh)
  	{
 		SDOutp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL,
 			SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)|(1<<2) );		// SD Clock enable
-		while ( !( SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ) & (1<<3) ) );// SDHC_clockSource is Stable
+		SDHC_WaitClock( sCh, 1<<3 );	// SDHC_clockSource is Stable
 	}
 }
 
@@ -1102,7 +1117,7 @@ void SDHC_SetSdClock(SDHC* sCh, SDHC_SpeedMode speed)
 		(SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)&(~(0xff<<8)))|(sCh->m_uClockDivision<<8)|(1<<0) );
 
 	// CheckInternalClockStable
-	while (!(SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL )&0x2));
+	SDHC_WaitClock( sCh, 0x2 );
 
 	SDHC_SetSdClockOnOff( TRUE, sCh);
 	debug("rHM_CONTROL2 = %x\n",SDInp32( sCh->m_uBaseAddr+SDHC_CONTROL2 ));
@@ -1182,7 +1197,7 @@ void SDHC_Set_InitClock( SDHC* sCh ) {
 		(SDInp16(sCh->m_uBaseAddr+SDHC_CLK_CTRL)&(~(0xff<<8)))|(0x80<<8)|(1<<0) );
 
 	// CheckInternalClockStable
-	while (!(SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL )&0x2));
+	SDHC_WaitClock( sCh, 0x2 );
 	SDHC_SetSdClockOnOff( TRUE, sCh);
 	//CONSOL_Printf("rHM_CONTROL2 = %x\n",SDInp32( sCh->m_uBaseAddr+SDHC_CONTROL2 ));
 	//CONSOL_Printf("rHM_CLKCON = %x\n",SDInp16( sCh->m_uBaseAddr+SDHC_CLK_CTRL ));
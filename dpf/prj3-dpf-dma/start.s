@@ -5,9 +5,25 @@ _start:
 	@ldr sp, =0xD0028000	
 	@ldr sp, =0x30000000
 
+	@ IRQ mode stack, once: asm_IRQ_handler only passes 2 words through it
+	msr cpsr_c, #0xD2
+	ldr sp, =0xD0034000
+	msr cpsr_c, #0xD3
+
 	mov r0, #0x53
 	msr	CPSR_cxsf, r0
 
+	@ CPACR: CP10/CP11 (VFP, NEON) full access
+	mrc p15, 0, r0, c1, c0, 2
+	orr r0, r0, #(0xf << 20)
+	mcr p15, 0, r0, c1, c0, 2
+	mov r0, #0
+	mcr p15, 0, r0, c7, c5, 4	@ isb, CP15 form: no isb mnemonic before ARMv7
+
+	@ FPEXC.EN
+	mov r0, #0x40000000
+	vmsr fpexc, r0
+
 	bl tzpc_init
 
 	stmfd sp!, {lr}
@@ -10,5 +10,12 @@ char * gets(char * s);
 
 int printf(const char * format, ...);
 
+#include <stdarg.h>
+
+// as C99: the length the whole output would have, at most size - 1 stored
+int snprintf(char * buf, int size, const char * format, ...);
+
+int vsnprintf(char * buf, int size, const char * format, va_list ap);
+
 
 
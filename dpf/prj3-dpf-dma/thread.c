@@ -0,0 +1,446 @@
+
+#include "stdio.h"
+#include "pmu.h"
+#include "vic.h"
+#include "timer.h"
+#include "thread.h"
+
+#define STACK_FILL	0xDEADBEEF
+#define VFP_WORDS	66		// d0-d31, fpscr, fpexc
+#define FRAME_WORDS	(VFP_WORDS + 16)	// and r4-r11, r0-r3, r12, lr, spsr, pc
+#define FPEXC_EN	0x40000000
+#define SVC_IRQS_ON	0x53		// the cpsr main runs with, see start.s
+
+volatile int irq_depth;
+volatile int need_resched;
+
+static struct thread threads[THREAD_MAX];
+static unsigned int thread_stacks[THREAD_MAX - 1][THREAD_STACK_SIZE / 4] __attribute__((aligned(8)));
+
+static struct thread * ready_head[THREAD_PRIOS];
+static struct thread * ready_tail[THREAD_PRIOS];
+static struct thread * current;
+static int round_robin;			// current goes behind the others of its priority
+
+// all of these with irqs off
+
+static void _ready_push(struct thread * t, int front)
+{
+	int p = t->prio;
+
+	t->state = THREAD_READY;
+	if (!ready_head[p]) {
+		t->next = 0;
+		ready_head[p] = ready_tail[p] = t;
+	} else if (front) {
+		t->next = ready_head[p];
+		ready_head[p] = t;
+	} else {
+		t->next = 0;
+		ready_tail[p]->next = t;
+		ready_tail[p] = t;
+	}
+}
+
+// irq.s, with the frame of the thread leaving at sp: returns the frame of
+// the one to run. Idle is always ready, so there is one.
+unsigned int * _thread_schedule(unsigned int * sp)
+{
+	struct thread * t = current;
+	int p;
+
+	t->sp = sp;
+	need_resched = 0;
+	if (t->state == THREAD_RUNNING)
+		_ready_push(t, !round_robin);
+	round_robin = 0;
+
+	for (p = 0; !ready_head[p]; p++)
+		;
+	t = ready_head[p];
+	ready_head[p] = t->next;
+
+	if (t != current)
+		t->switches++;
+	if (t != current || t->slice <= 0)
+		t->slice = THREAD_SLICE;
+	t->state = THREAD_RUNNING;
+	current = t;
+
+	return t->sp;
+}
+
+static void _wake(struct thread * t)
+{
+	_ready_push(t, 0);
+	if (t->prio < current->prio)
+		need_resched = 1;
+}
+
+// in a handler the switch waits for the irq return
+static void _resched(void)
+{
+	if (need_resched && !irq_depth)
+		thread_switch();
+}
+
+static void _block(struct thread ** list)
+{
+	struct thread ** pp = list;
+
+	while (*pp)
+		pp = &(*pp)->next;
+	current->next = 0;
+	*pp = current;
+	current->state = THREAD_BLOCKED;
+	thread_switch();
+}
+
+// the most urgent waiter, the longest waiting of them
+static struct thread * _unblock(struct thread ** list)
+{
+	struct thread ** pp, ** best = 0;
+	struct thread * t;
+
+	for (pp = list; *pp; pp = &(*pp)->next)
+		if (!best || (*pp)->prio < (*best)->prio)
+			best = pp;
+	if (!best)
+		return 0;
+
+	t = *best;
+	*best = t->next;
+	return t;
+}
+
+static void _idle(void * arg)
+{
+	while (1)
+		;
+}
+
+void thread_init(int prio)
+{
+	int i;
+
+	for (i = 0; i < THREAD_MAX; i++)
+		threads[i].state = THREAD_FREE;
+	for (i = 0; i < THREAD_PRIOS; i++)
+		ready_head[i] = 0;
+
+	current = &threads[0];
+	current->name = "main";
+	current->prio = prio;
+	current->slice = THREAD_SLICE;
+	current->switches = 0;
+	current->stack = 0;
+	current->state = THREAD_RUNNING;
+
+	thread_create("idle", _idle, 0, THREAD_PRIOS - 1);
+}
+
+struct thread * thread_create(const char * name, void (*entry)(void * arg),
+		void * arg, int prio)
+{
+	struct thread * t = 0;
+	unsigned int * sp, flags;
+	int i;
+
+	if (prio < 0 || prio >= THREAD_PRIOS)
+		return 0;
+
+	flags = irq_save();
+	for (i = 1; i < THREAD_MAX; i++)
+		if (threads[i].state == THREAD_FREE) {
+			t = &threads[i];
+			t->state = THREAD_BLOCKED;	// taken, not runnable yet
+			break;
+		}
+	irq_restore(flags);
+	if (!t)
+		return 0;
+
+	t->name = name;
+	t->prio = prio;
+	t->switches = 0;
+	t->stack = thread_stacks[i - 1];
+	for (i = 0; i < THREAD_STACK_SIZE / 4; i++)
+		t->stack[i] = STACK_FILL;
+
+	// as if an irq had taken it off the CPU at entry(arg)
+	sp = t->stack + THREAD_STACK_SIZE / 4 - FRAME_WORDS;
+	for (i = 0; i < FRAME_WORDS; i++)
+		sp[i] = 0;
+	sp[VFP_WORDS - 1] = FPEXC_EN;			// fpexc, fpscr 0
+	sp[VFP_WORDS + 8] = (unsigned int)arg;		// r0
+	sp[VFP_WORDS + 13] = (unsigned int)thread_exit;	// lr
+	sp[VFP_WORDS + 14] = SVC_IRQS_ON;		// spsr
+	sp[VFP_WORDS + 15] = (unsigned int)entry;	// pc
+	t->sp = sp;
+
+	flags = irq_save();
+	_wake(t);
+	_resched();
+	irq_restore(flags);
+
+	return t;
+}
+
+void thread_exit(void)
+{
+	irq_save();
+	current->state = THREAD_FREE;
+	thread_switch();
+}
+
+void thread_yield(void)
+{
+	unsigned int flags = irq_save();
+
+	round_robin = 1;
+	thread_switch();
+	irq_restore(flags);
+}
+
+void thread_sleep(unsigned int ms)
+{
+	unsigned int flags, n = ms * HZ / 1000;
+
+	flags = irq_save();
+	current->wake = jiffies + (n ? n : 1);
+	current->state = THREAD_SLEEPING;
+	thread_switch();
+	irq_restore(flags);
+}
+
+struct thread * thread_self(void)
+{
+	return current;
+}
+
+void thread_tick(void)
+{
+	struct thread * t;
+
+	if (!current)
+		return;
+
+	for (t = threads; t < threads + THREAD_MAX; t++)
+		if (t->state == THREAD_SLEEPING && time_after_eq(jiffies, t->wake))
+			_wake(t);
+
+	if (--current->slice <= 0 && ready_head[current->prio]) {
+		round_robin = 1;
+		need_resched = 1;
+	}
+}
+
+void sem_init(struct sem * s, int count)
+{
+	s->count = count;
+	s->waiters = 0;
+}
+
+// a post to a waiter hands it the count directly
+void sem_wait(struct sem * s)
+{
+	unsigned int flags = irq_save();
+
+	if (s->count > 0)
+		s->count--;
+	else
+		_block(&s->waiters);
+	irq_restore(flags);
+}
+
+int sem_trywait(struct sem * s)
+{
+	unsigned int flags = irq_save();
+	int ret = -1;
+
+	if (s->count > 0) {
+		s->count--;
+		ret = 0;
+	}
+	irq_restore(flags);
+
+	return ret;
+}
+
+void sem_post(struct sem * s)
+{
+	unsigned int flags = irq_save();
+	struct thread * t = _unblock(&s->waiters);
+
+	if (t)
+		_wake(t);
+	else
+		s->count++;
+	_resched();
+	irq_restore(flags);
+}
+
+void msgq_init(struct msgq * q, unsigned int * buf, int size)
+{
+	q->buf = buf;
+	q->size = size;
+	q->head = 0;
+	q->tail = 0;
+	sem_init(&q->items, 0);
+	sem_init(&q->slots, size);
+}
+
+static void _put(struct msgq * q, unsigned int msg)
+{
+	unsigned int flags = irq_save();
+
+	q->buf[q->head] = msg;
+	if (++q->head == q->size)
+		q->head = 0;
+	irq_restore(flags);
+}
+
+static unsigned int _get(struct msgq * q)
+{
+	unsigned int flags = irq_save();
+	unsigned int msg = q->buf[q->tail];
+
+	if (++q->tail == q->size)
+		q->tail = 0;
+	irq_restore(flags);
+
+	return msg;
+}
+
+void msgq_send(struct msgq * q, unsigned int msg)
+{
+	sem_wait(&q->slots);
+	_put(q, msg);
+	sem_post(&q->items);
+}
+
+int msgq_trysend(struct msgq * q, unsigned int msg)
+{
+	if (sem_trywait(&q->slots))
+		return -1;
+	_put(q, msg);
+	sem_post(&q->items);
+
+	return 0;
+}
+
+unsigned int msgq_recv(struct msgq * q)
+{
+	unsigned int msg;
+
+	sem_wait(&q->items);
+	msg = _get(q);
+	sem_post(&q->slots);
+
+	return msg;
+}
+
+int msgq_tryrecv(struct msgq * q, unsigned int * msg)
+{
+	if (sem_trywait(&q->items))
+		return -1;
+	*msg = _get(q);
+	sem_post(&q->slots);
+
+	return 0;
+}
+
+void thread_show(void)
+{
+	static const char * states[] = { "free", "ready", "running", "blocked", "sleeping" };
+	struct thread * t;
+	int used;
+
+	for (t = threads; t < threads + THREAD_MAX; t++) {
+		if (t->state == THREAD_FREE)
+			continue;
+
+		used = 0;
+		if (t->stack)
+			for (used = THREAD_STACK_SIZE / 4; used > 0; used--)
+				if (t->stack[THREAD_STACK_SIZE / 4 - used] != STACK_FILL)
+					break;
+		printf("thread %-8s prio %d %-8s %8u switches, stack %d / %d\n",
+			t->name, t->prio, states[t->state], t->switches,
+			used * 4, t->stack ? THREAD_STACK_SIZE : 0);
+	}
+}
+
+#define BENCH_ROUNDS	1000
+
+static struct sem bench_ping, bench_pong, bench_done;
+static unsigned int bench_start;
+
+// the first of a pair starts its peer, of the same priority so it waits
+// its turn, and then the clock
+static void _bench_yield(void * arg)
+{
+	int i;
+
+	if (arg) {
+		thread_create("yield b", _bench_yield, 0, current->prio);
+		bench_start = pmu_get_cycles();
+	}
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		thread_yield();
+	sem_post(&bench_done);
+}
+
+static void _bench_pong(void * arg);
+
+static void _bench_ping(void * arg)
+{
+	int i;
+
+	thread_create("pong", _bench_pong, 0, current->prio);
+	bench_start = pmu_get_cycles();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		sem_post(&bench_ping);
+		sem_wait(&bench_pong);
+	}
+	sem_post(&bench_done);
+}
+
+static void _bench_pong(void * arg)
+{
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		sem_wait(&bench_ping);
+		sem_post(&bench_pong);
+	}
+	sem_post(&bench_done);
+}
+
+// two threads above the caller take turns BENCH_ROUNDS times each, two
+// switches a round; the caller waits on bench_done meanwhile
+void thread_bench(void)
+{
+	unsigned int c;
+	int prio = current->prio - 1;
+
+	if (prio < 0) {
+		puts("thread bench: needs a caller below priority 0");
+		return;
+	}
+
+	sem_init(&bench_done, 0);
+	thread_create("yield a", _bench_yield, (void *)1, prio);
+	sem_wait(&bench_done);
+	sem_wait(&bench_done);
+	c = pmu_get_cycles() - bench_start;
+	printf("thread_yield switch: %u cycles\n", c / (2 * BENCH_ROUNDS));
+
+	sem_init(&bench_ping, 0);
+	sem_init(&bench_pong, 0);
+	thread_create("ping", _bench_ping, 0, prio);
+	sem_wait(&bench_done);
+	sem_wait(&bench_done);
+	c = pmu_get_cycles() - bench_start;
+	printf("sem_post / sem_wait switch: %u cycles\n", c / (2 * BENCH_ROUNDS));
+}
@@ -0,0 +1,88 @@
+
+// Preemptive priority threads in SVC mode. The highest priority thread
+// that is ready runs; threads of one priority take turns every
+// THREAD_SLICE jiffies (timer.h) or on thread_yield(). A handler that
+// wakes a more urgent thread (sem_post(), msgq_trysend()) switches to it
+// when the outermost irq returns, see irq.s.
+//
+// Every switch saves and restores the VFP / NEON registers, FPSCR and
+// FPEXC (264 bytes of the thread's stack), so any thread may use NEON.
+
+#define THREAD_MAX		8		// main and idle included
+#define THREAD_PRIOS		8		// 0 highest; idle is THREAD_PRIOS - 1
+#define THREAD_STACK_SIZE	8192		// each, from a static pool
+#define THREAD_SLICE		10		// jiffies
+
+enum { THREAD_FREE, THREAD_READY, THREAD_RUNNING, THREAD_BLOCKED, THREAD_SLEEPING };
+
+struct thread {
+	unsigned int * sp;			// saved, see irq.s for the frame
+	int state;
+	int prio;
+	int slice;
+	const char * name;
+	struct thread * next;			// ready queue or wait list
+	unsigned int wake;			// jiffies, when THREAD_SLEEPING
+	unsigned int switches;			// times it was switched in
+	unsigned int * stack;			// 0 for main, which keeps its own
+};
+
+// asm_IRQ_handler levels not returned yet; switching waits for 0
+extern volatile int irq_depth;
+extern volatile int need_resched;
+
+// main becomes a thread of priority prio, the idle thread starts
+void thread_init(int prio);
+
+// entry(arg) at priority prio, ready now; returning from entry exits.
+// 0 when no slot is free
+struct thread * thread_create(const char * name, void (*entry)(void * arg),
+		void * arg, int prio);
+
+void thread_exit(void);
+void thread_yield(void);
+
+// needs the timer of timer_init() running
+void thread_sleep(unsigned int ms);
+
+struct thread * thread_self(void);
+
+// timer irq, every jiffy: wakes sleepers, ends time slices
+void thread_tick(void);
+
+// switches, state and stack high water of every thread
+void thread_show(void);
+
+// cycles of a thread_yield() switch and of a semaphore hand-over
+void thread_bench(void);
+
+// irq.s: saves the current thread, runs _thread_schedule(); irqs off
+void thread_switch(void);
+
+// counting semaphore; sem_post() and sem_trywait() may be called from
+// handlers, sem_wait() only from threads
+struct sem {
+	volatile int count;
+	struct thread * waiters;
+};
+
+void sem_init(struct sem * s, int count);
+void sem_wait(struct sem * s);
+int sem_trywait(struct sem * s);		// 0 when it took one, else -1
+void sem_post(struct sem * s);
+
+// queue of size words; the try versions may be called from handlers
+struct msgq {
+	unsigned int * buf;
+	int size;
+	int head;
+	int tail;
+	struct sem items;
+	struct sem slots;
+};
+
+void msgq_init(struct msgq * q, unsigned int * buf, int size);
+void msgq_send(struct msgq * q, unsigned int msg);
+int msgq_trysend(struct msgq * q, unsigned int msg);		// -1 when full
+unsigned int msgq_recv(struct msgq * q);
+int msgq_tryrecv(struct msgq * q, unsigned int * msg);	// -1 when empty
@@ -0,0 +1,75 @@
+
+#include "ticks.h"
+#include "vic.h"
+
+#define TCFG0		(*(volatile unsigned int *)0xE2500000)
+#define TCFG1		(*(volatile unsigned int *)0xE2500004)
+#define TCON		(*(volatile unsigned int *)0xE2500008)
+#define TCNTB4		(*(volatile unsigned int *)0xE250003C)
+#define TCNTO4		(*(volatile unsigned int *)0xE2500040)
+
+static int ticks_started;
+static unsigned int ticks_hi, ticks_last;
+
+void ticks_init(void)
+{
+	// prescaler 1 (timers 2 ~ 4): PCLK / (65+1) = 1M, timer 4 divider 1/1;
+	// prescaler 0 and the other dividers belong to timer.c
+	TCFG0 = (TCFG0 & ~(0xff<<8)) | (65<<8);
+	TCFG1 &= ~(0xf<<16);
+
+	// counts down from 0xFFFFFFFF and reloads it
+	TCNTB4 = 0xffffffff;
+	// TCON timer 4: [20] start, [21] manual update, [22] auto-reload
+	TCON = (TCON & ~(7<<20)) | (1<<21);
+	TCON = (TCON & ~(7<<20)) | (1<<22) | (1<<20);
+
+	ticks_hi = 0;
+	ticks_last = 0;
+	ticks_started = 1;
+}
+
+unsigned long long get_ticks(void)
+{
+	unsigned int now, hi, flags;
+
+	if (!ticks_started)
+		ticks_init();
+
+	// irq off: the wrap check and the update of ticks_hi go together
+	flags = irq_save();
+
+	now = ~TCNTO4;			// counting up from 0
+	if (now < ticks_last)
+		ticks_hi++;
+	ticks_last = now;
+	hi = ticks_hi;
+
+	irq_restore(flags);
+
+	return (unsigned long long)hi << 32 | now;
+}
+
+void udelay(unsigned int us)
+{
+	unsigned long long t = get_ticks() + us * TICKS_PER_US;
+
+	while (get_ticks() < t)
+		;
+}
+
+void mdelay(unsigned int ms)
+{
+	while (ms--)
+		udelay(1000);
+}
+
+unsigned long long timeout_start(unsigned int us)
+{
+	return get_ticks() + us * TICKS_PER_US;
+}
+
+int timeout_expired(unsigned long long deadline)
+{
+	return get_ticks() >= deadline;
+}
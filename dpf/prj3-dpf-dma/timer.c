@@ -1,4 +1,11 @@
 
+#include "stdio.h"
+#include "pmu.h"
+#include "vic.h"
+#include "event.h"
+#include "timer.h"
+#include "thread.h"
+
 #define GPH2CON		(*(volatile unsigned int *)0xE0200C40)
 #define GPH2DAT		(*(volatile unsigned int *)0xE0200C44)
 
@@ -10,48 +17,237 @@
 #define TCMPB0		(*(volatile unsigned int *)0xE2500010)
 #define TCNTO0		(*(volatile unsigned int *)0xE2500014)
 #define TINT_CSTAT	(*(volatile unsigned int *)0xE2500044)
-   
-// VIC
-#define VIC0RAWINTR		(*(volatile unsigned int *)0xF2000008)
-#define VIC0IRQSTATUS		(*(volatile unsigned int *)0xF2000000)
-#define VIC0FIQSTATUS		(*(volatile unsigned int *)0xF2000004)
-#define VIC0INTENABLE		(*(volatile unsigned int *)0xF2000010)
-#define VIC0INTSELECT		(*(volatile unsigned int *)0xF200000C)
-#define VIC0VECTADDR16		(*(volatile unsigned int *)0xF2000140)
-#define VIC0VECTADDR21		(*(volatile unsigned int *)0xF2000154)
-
-#define VIC0ADDRESS		(*(volatile unsigned int *)0xF2000F00)
-  
-// hooker of user
-extern void user_irq_handler(void);
-
-void C_IRQ_handler(void)
+
+#define TV1_BITS	8
+#define TVN_BITS	6
+#define TV1_SIZE	(1 << TV1_BITS)
+#define TVN_SIZE	(1 << TVN_BITS)
+#define TVN_LEVELS	4
+
+// slot of level n (0 ~ 3) for jiffy j
+#define TVN_INDEX(j, n)	(((j) >> (TV1_BITS + (n) * TVN_BITS)) & (TVN_SIZE - 1))
+
+volatile unsigned int jiffies;
+
+static struct timer_list * tv1[TV1_SIZE];
+static struct timer_list * tvn[TVN_LEVELS][TVN_SIZE];
+static unsigned int timer_jiffies;		// the next jiffy the wheel runs
+static int timer_count;
+static struct work timer_work;
+
+#define EV_TICK		1
+static struct event_queue timer_events;		// timer0_irq() -> _run(), one a jiffy
+
+static struct {
+	unsigned int runs;
+	unsigned int fired;
+	unsigned int cascaded;
+	unsigned int max_cycles;		// one run of the wheel, callbacks included
+	unsigned int max_lag;			// jiffies behind when it ran
+} timer_stats;
+
+static void _link(struct timer_list ** head, struct timer_list * t)
+{
+	t->next = *head;
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = head;
+	*head = t;
+}
+
+static void _unlink(struct timer_list * t)
+{
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->pprev = 0;
+}
+
+// the slot by how far off expires is: 256 jiffies, 16K, 1M, 64M, the rest
+static void _add(struct timer_list * t)
+{
+	unsigned int expires = t->expires;
+	unsigned int delta = expires - timer_jiffies;
+	struct timer_list ** head;
+
+	if ((int)delta < 0)
+		head = &tv1[timer_jiffies & (TV1_SIZE - 1)];	// due already: the next run
+	else if (delta < 1 << TV1_BITS)
+		head = &tv1[expires & (TV1_SIZE - 1)];
+	else if (delta < 1 << (TV1_BITS + TVN_BITS))
+		head = &tvn[0][TVN_INDEX(expires, 0)];
+	else if (delta < 1 << (TV1_BITS + 2 * TVN_BITS))
+		head = &tvn[1][TVN_INDEX(expires, 1)];
+	else if (delta < 1 << (TV1_BITS + 3 * TVN_BITS))
+		head = &tvn[2][TVN_INDEX(expires, 2)];
+	else
+		head = &tvn[3][TVN_INDEX(expires, 3)];
+
+	_link(head, t);
+}
+
+// empties slot index of level n into the finer levels, returns index so
+// the next level cascades too when this one wrapped to 0
+static int _cascade(int n, int index)
 {
-	// clear pending bit	
-	TINT_CSTAT |= 1<<5;
- 				
-	// clear VIC0ADDRESS  0xF200_0F00 R/W 
- 	VIC0ADDRESS = 0;
+	struct timer_list * t = tvn[n][index];
+	struct timer_list * next;
 
-	// call beep
-	// beep();	
-	user_irq_handler();
-}		
+	tvn[n][index] = 0;
+	while (t) {
+		next = t->next;
+		t->pprev = 0;
+		_add(t);
+		timer_stats.cascaded++;
+		t = next;
+	}
+
+	return index;
+}
+
+// work_run() context: the ticks in timer_events, everything due up to each.
+// A tick that found the ring full is covered by the next one, which carries
+// a later jiffy.
+static void _run(void * ctx)
+{
+	struct timer_list * head, * t;
+	struct event e;
+	unsigned int flags, cycles, lag, index;
+	void (*function)(void *);
+	void * arg;
 
-extern void asm_IRQ_handler(void);
+	cycles = pmu_get_cycles();
+	lag = jiffies - timer_jiffies;
+	if (time_after_eq(jiffies, timer_jiffies) && lag > timer_stats.max_lag)
+		timer_stats.max_lag = lag;
+
+	while (event_get(&timer_events, &e)) {
+		flags = irq_save();
+		while (time_after_eq(e.arg, timer_jiffies)) {
+			index = timer_jiffies & (TV1_SIZE - 1);
+			if (!index && !_cascade(0, TVN_INDEX(timer_jiffies, 0))
+				&& !_cascade(1, TVN_INDEX(timer_jiffies, 1))
+				&& !_cascade(2, TVN_INDEX(timer_jiffies, 2)))
+				_cascade(3, TVN_INDEX(timer_jiffies, 3));
+			timer_jiffies++;
+
+			// off the wheel onto a local head, so a callback may del_timer()
+			// another timer of this slot
+			head = tv1[index];
+			tv1[index] = 0;
+			if (head)
+				head->pprev = &head;
+			while ((t = head)) {
+				_unlink(t);
+				timer_count--;
+				function = t->function;
+				arg = t->ctx;
+				timer_stats.fired++;
+
+				irq_restore(flags);
+				function(arg);
+				flags = irq_save();
+			}
+		}
+		irq_restore(flags);
+	}
+
+	timer_stats.runs++;
+	cycles = pmu_get_cycles() - cycles;
+	if (cycles > timer_stats.max_cycles)
+		timer_stats.max_cycles = cycles;
+}
+
+// VIC0[21], see vic.c
+static void timer0_irq(void * ctx)
+{
+	// clear pending bit, only ours: timer 1 of prof.c shares [9:5]
+	TINT_CSTAT = (TINT_CSTAT & 0x1f) | (1<<5);
+
+	jiffies++;
+	event_post(&timer_events, EV_TICK, jiffies);
+	work_schedule(&timer_work);
+	thread_tick();
+}
+
+void setup_timer(struct timer_list * t, void (*function)(void * ctx), void * ctx)
+{
+	t->function = function;
+	t->ctx = ctx;
+	t->pprev = 0;
+}
+
+void add_timer(struct timer_list * t)
+{
+	unsigned int flags = irq_save();
+
+	_add(t);
+	timer_count++;
+	irq_restore(flags);
+}
+
+int mod_timer(struct timer_list * t, unsigned int expires)
+{
+	unsigned int flags = irq_save();
+	int pending = timer_pending(t);
+
+	if (pending)
+		_unlink(t);
+	else
+		timer_count++;
+	t->expires = expires;
+	_add(t);
+	irq_restore(flags);
+
+	return pending;
+}
+
+int del_timer(struct timer_list * t)
+{
+	unsigned int flags = irq_save();
+	int pending = timer_pending(t);
+
+	if (pending) {
+		_unlink(t);
+		timer_count--;
+	}
+	irq_restore(flags);
+
+	return pending;
+}
+
+int timers_pending(void)
+{
+	return timer_count;
+}
+
+void timer_stats_show(void)
+{
+	printf("timers: %d pending, jiffies %u, %u runs, %u fired, %u cascaded, "
+		"run max %u cycles, lag max %u jiffies, %u ticks dropped\n",
+		timer_count, jiffies, timer_stats.runs, timer_stats.fired,
+		timer_stats.cascaded, timer_stats.max_cycles, timer_stats.max_lag,
+		timer_events.dropped);
+}
 
 int timer_init(void)
 {
+	jiffies = 0;
+	timer_jiffies = 0;
+	event_queue_init(&timer_events);
+	work_init(&timer_work, _run, 0);
+
 	// Interrupt init 
 	// INT Source init
 	// PCLK / (65+1) = 1M
-	TCFG0 = 65;
+	// prescaler 1 and the timer 4 divider belong to ticks.c
+	TCFG0 = (TCFG0 & ~0xff) | 65;
 	
-	// 1M/16 = 62500hz
-	TCFG1 = 0x4;
+	// 1M/1, one count a us
+	TCFG1 = (TCFG1 & ~0xf) | 0x0;
 	
-	// 1s = 62500hz
-	TCNTB0 = 62500*4;
+	// it counts TCNTB0 ~ 0: one tick every 1000000 / HZ us
+	TCNTB0 = 1000000/HZ - 1;
 	
 	// Set the manual update bit 
 	TCON |= 1<<1;
@@ -66,30 +262,10 @@ int timer_init(void)
 	TCON |= 1<<3;		
 		
 	// step 4: Enable interrupt TINT_CSTAT bit[0] 
-	TINT_CSTAT |= 1<<0;
+	TINT_CSTAT = (TINT_CSTAT & 0x1f) | (1<<0);
 	
-	// VIC init
-	// (VICINTENABLE, R/W, Address=0xF200_0010,
-	VIC0INTENABLE |= (1<<21);		// enable EINT[21]
-	
-	// VIC0INTSELECT  0xF200_000C R/W 	0:IRQ	1:FIQ
-	//*(int *)0xF200000C |= (1<<21);		// enable FIQ
-	VIC0INTSELECT &= ~(1<<21);		// enable IRQ
+	// below the DMA and UART interrupts, it only counts the jiffy
+	irq_register(INT_TIMER0, timer0_irq, 0, 8);
 
-	// init CPSR I-bit (open IRQ disable bit)	0xD3->0x53
-	// see it in start.s
-	
-	// open VIC port 
-	// in Cortex A8 core, It seems VIC is open as default 
-	
-#define VIC	
-//#undef VIC
-#ifdef VIC
-	// install IRQ handler to Vectors	
-	VIC0VECTADDR21 = (int)asm_IRQ_handler;
-#else
-	// set all exception vectors addresses from 0xD0037400
-	*(int *)(0xD0037400 + 0x18) = (int)asm_IRQ_handler;	
-#endif
 	return 0;
 }
@@ -1,3 +1,48 @@
 
+// Software timers on PWM timer 0: it ticks at HZ and every tick only
+// counts jiffies, posts the jiffy to an event ring and schedules a work
+// (event.h); work_run() in the main loop takes the ticks off the ring with
+// event_get() and runs the timers due up to each, late by however long
+// the main loop was away. Pending timers sit in a hierarchical wheel, 256 slots
+// of one jiffy and four levels of 64 slots, each 64 times coarser, that
+// are moved down as their time nears; add, mod and del are O(1).
+
+#define HZ		1000
+
+extern volatile unsigned int jiffies;
+
+// true when jiffy a is after b, across the 32-bit wrap (49 days)
+#define time_after(a, b)	((int)((b) - (a)) < 0)
+#define time_after_eq(a, b)	((int)((a) - (b)) >= 0)
+
+struct timer_list {
+	struct timer_list * next;
+	struct timer_list ** pprev;		// 0 when not pending
+	unsigned int expires;			// jiffies
+	void (*function)(void * ctx);
+	void * ctx;
+};
+
 int timer_init(void);
 
+void setup_timer(struct timer_list * t, void (*function)(void * ctx), void * ctx);
+
+// t->expires set by the caller; t must not be pending
+void add_timer(struct timer_list * t);
+
+// (re)arms t for expires, returns 1 if it was pending
+int mod_timer(struct timer_list * t, unsigned int expires);
+
+// returns 1 if it was pending
+int del_timer(struct timer_list * t);
+
+static inline int timer_pending(const struct timer_list * t)
+{
+	return t->pprev != 0;
+}
+
+// timers in the wheel
+int timers_pending(void);
+
+// pending timers, ticks and the CCNT cycles spent running the wheel
+void timer_stats_show(void);
@@ -0,0 +1,243 @@
+// trace-decode: turn a binary trace_dump() back into printf text
+//
+// trace-decode [-c] file.elf capture
+//
+// capture is whatever came in on the serial line (a terminal log file or
+// the tty itself), the dump is found by its TRACE_MAGIC. Format strings
+// and string literal arguments are read from the .elf at the addresses
+// the board logged. Each line gets the time since the first event in us
+// (CCNT at 1GHz, unwrapped on the assumption that events are less than
+// 4.3s apart), -c prints raw cycles instead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "../trace.h"
+
+struct section {
+	unsigned int addr, size;
+	const unsigned char * data;
+};
+
+static unsigned char * elf;
+static struct section sects[64];
+static int nsects;
+
+static unsigned char * load(const char * path, long * size)
+{
+	FILE * f = fopen(path, "rb");
+	unsigned char * buf;
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(*size + 1);
+	if (!buf || fread(buf, 1, *size, f) != (size_t)*size) {
+		fprintf(stderr, "%s: read failed\n", path);
+		exit(1);
+	}
+	fclose(f);
+
+	return buf;
+}
+
+// every allocated section with contents (.text, .rodata, .data)
+static void elf_sections(const char * path)
+{
+	long size;
+	Elf32_Ehdr * eh;
+	Elf32_Shdr * sh;
+	int i;
+
+	elf = load(path, &size);
+	eh = (Elf32_Ehdr *)elf;
+	if (size < (long)sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) ||
+			eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_ident[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s: not a little endian ELF32 file\n", path);
+		exit(1);
+	}
+
+	sh = (Elf32_Shdr *)(elf + eh->e_shoff);
+	for (i = 0; i < eh->e_shnum && nsects < 64; i++) {
+		if (!(sh[i].sh_flags & SHF_ALLOC) || sh[i].sh_type != SHT_PROGBITS)
+			continue;
+		sects[nsects].addr = sh[i].sh_addr;
+		sects[nsects].size = sh[i].sh_size;
+		sects[nsects].data = elf + sh[i].sh_offset;
+		nsects++;
+	}
+}
+
+// the NUL terminated string at a board address, 0 if it isn't in the .elf
+static const char * elf_string(unsigned int addr)
+{
+	const struct section * s;
+	unsigned int off;
+	int i;
+
+	for (i = 0; i < nsects; i++) {
+		s = &sects[i];
+		if (addr < s->addr || addr - s->addr >= s->size)
+			continue;
+		for (off = addr - s->addr; off < s->size; off++)
+			if (s->data[off] == '\0')
+				return (const char *)s->data + (addr - s->addr);
+		return 0;
+	}
+
+	return 0;
+}
+
+static unsigned int word(const unsigned char * p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+// printf of the board's fmt with its 32-bit args: each conversion is
+// copied out without length modifiers and printed with a host type
+static void print_event(const char * fmt, const unsigned int * arg, int nargs)
+{
+	char spec[32];
+	const char * s;
+	int n, a = 0;
+	unsigned int v;
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+
+		n = 0;
+		spec[n++] = *fmt++;
+		while (*fmt && strchr("-+ #0123456789.*hl", *fmt) && n < 28) {
+			if (*fmt == '*') {
+				// the width / precision was logged as an argument
+				n += sprintf(spec + n, "%d", a < nargs ? (int)arg[a] : 0);
+				a++;
+			} else if (*fmt != 'h' && *fmt != 'l')
+				spec[n++] = *fmt;
+			fmt++;
+		}
+		if (!*fmt)
+			break;
+		spec[n++] = *fmt;
+		spec[n] = '\0';
+
+		v = a < nargs ? arg[a] : 0;
+		switch (*fmt++) {
+		case '%':
+			putchar('%');
+			continue;
+		case 'd':
+		case 'i':
+			printf(spec, (int)v);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'c':
+			printf(spec, v);
+			break;
+		case 'p':
+			printf("0x%08x", v);
+			break;
+		case 's':
+			s = elf_string(v);
+			if (s)
+				printf(spec, s);
+			else
+				// a buffer on the board, only its address was logged
+				printf("<%08x>", v);
+			break;
+		default:
+			fputs(spec, stdout);
+			continue;
+		}
+		a++;
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const unsigned char * p, * end;
+	unsigned char * cap;
+	unsigned int n, nargs, i, j, fmtaddr, cycles, last = 0;
+	unsigned int arg[16];
+	unsigned long long t = 0;
+	const char * fmt;
+	int raw = 0;
+	long size;
+
+	if (argc > 1 && !strcmp(argv[1], "-c")) {
+		raw = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 3) {
+		fprintf(stderr, "usage: trace-decode [-c] file.elf capture\n");
+		return 1;
+	}
+
+	elf_sections(argv[1]);
+	cap = load(argv[2], &size);
+	end = cap + size;
+
+	for (p = cap; p + 12 <= end; p++)
+		if (word(p) == TRACE_MAGIC)
+			break;
+	if (p + 12 > end) {
+		fprintf(stderr, "%s: no trace dump in it\n", argv[2]);
+		return 1;
+	}
+
+	n = word(p + 4);
+	nargs = word(p + 8);
+	p += 12;
+	if (nargs > 16) {
+		fprintf(stderr, "%s: %u arguments per event?\n", argv[2], nargs);
+		return 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (p + (2 + nargs) * 4 > end) {
+			fprintf(stderr, "%s: cut after %u of %u events\n", argv[2], i, n);
+			return 1;
+		}
+		fmtaddr = word(p);
+		cycles = word(p + 4);
+		for (j = 0; j < nargs; j++)
+			arg[j] = word(p + 8 + j * 4);
+		p += (2 + nargs) * 4;
+
+		// unsigned difference carries over one CCNT wrap
+		if (i)
+			t += cycles - last;
+		last = cycles;
+		if (raw)
+			printf("[%10u] ", cycles);
+		else
+			printf("[%10llu.%03llu] ", t / 1000, t % 1000);
+
+		fmt = elf_string(fmtaddr);
+		if (!fmt) {
+			printf("<format at %08x not in the .elf>\n", fmtaddr);
+			continue;
+		}
+		print_event(fmt, arg, nargs);
+		// one line per event, also for the debug() pieces without '\n'
+		if (!*fmt || fmt[strlen(fmt) - 1] != '\n')
+			putchar('\n');
+	}
+
+	free(cap);
+	free(elf);
+
+	return 0;
+}
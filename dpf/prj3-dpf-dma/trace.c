@@ -0,0 +1,73 @@
+
+#include "uart.h"
+#include "pmu.h"
+#include "trace.h"
+#include "vic.h"
+
+int trace_on = 1;
+
+static struct trace_event trace_ring[TRACE_EVENTS];
+static unsigned int trace_head;		// runs free, wraps by mask
+
+void trace_event(const char * fmt, unsigned int a0, unsigned int a1, unsigned int a2,
+		unsigned int a3, unsigned int a4, unsigned int a5)
+{
+	struct trace_event * e;
+	unsigned int flags;
+
+	if (!trace_on)
+		return;
+
+	// irq off around taking the slot, events also come from irq context
+	flags = irq_save();
+
+	e = &trace_ring[trace_head++ & (TRACE_EVENTS - 1)];
+	e->fmt = (unsigned int)fmt;
+	e->cycles = pmu_get_cycles();
+	e->arg[0] = a0;
+	e->arg[1] = a1;
+	e->arg[2] = a2;
+	e->arg[3] = a3;
+	e->arg[4] = a4;
+	e->arg[5] = a5;
+
+	irq_restore(flags);
+}
+
+unsigned int trace_count(void)
+{
+	return trace_head;
+}
+
+// raw bytes, uart_write() would turn 0x0a into 0x0d 0x0a
+static void _put_words(const unsigned int * w, int n)
+{
+	const unsigned char * p = (const unsigned char *)w;
+
+	n *= 4;
+	while (n--)
+		uart_putchar(*p++);
+}
+
+void trace_dump(void)
+{
+	unsigned int head, n, i, hdr[3];
+	int on = trace_on;
+
+	// the ring holds still while it goes out
+	trace_on = 0;
+	head = trace_head;
+	n = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+
+	hdr[0] = TRACE_MAGIC;
+	hdr[1] = n;
+	hdr[2] = TRACE_ARGS;
+	_put_words(hdr, 3);
+	for (i = head - n; i != head; i++)
+		_put_words((unsigned int *)&trace_ring[i & (TRACE_EVENTS - 1)],
+			sizeof(struct trace_event) / 4);
+	uart_flush();
+
+	trace_head = 0;
+	trace_on = on;
+}
@@ -0,0 +1,49 @@
+
+// binary trace log: an event is the address of its printf format string
+// (in .rodata), the CCNT cycle count and up to TRACE_ARGS raw 32-bit
+// arguments, stored in a RAM ring; nothing is formatted on the board.
+// trace_dump() sends the ring over UART0 and trace-decode/ turns it back
+// into text with the format strings read out of the .elf:
+//   TRACE("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
+// %s arguments only come out as text when they point into the .elf
+// (string literals); anything else decodes as its address.
+
+#define TRACE_ARGS	6
+#define TRACE_EVENTS	4096		// power of 2, 32 bytes each
+
+// the dump: TRACE_MAGIC, events, TRACE_ARGS, then the events oldest first
+#define TRACE_MAGIC	0x45435254	// "TRCE" little endian
+
+struct trace_event {
+	unsigned int fmt;		// address of the format string
+	unsigned int cycles;		// CCNT, wraps every 4.3s at 1GHz
+	unsigned int arg[TRACE_ARGS];
+};
+
+extern int trace_on;			// 0 drops events
+
+void trace_event(const char * fmt, unsigned int a0, unsigned int a1, unsigned int a2,
+		unsigned int a3, unsigned int a4, unsigned int a5);
+
+// events logged since boot, the ring keeps the last TRACE_EVENTS
+unsigned int trace_count(void);
+
+// the ring in binary over UART0, then empties it
+void trace_dump(void);
+
+// missing arguments become 0, more than TRACE_ARGS don't compile (a zero
+// width bit-field)
+#ifdef TRACE_OFF
+#define TRACE(fmt, ...)		do { } while (0)
+#else
+#define TRACE(fmt, ...)		do { \
+		(void)sizeof(struct { int too_many_args : _TRACE_NARGS(__VA_ARGS__) <= TRACE_ARGS; }); \
+		_TRACE(fmt, ##__VA_ARGS__, 0, 0, 0, 0, 0, 0); \
+	} while (0)
+#endif
+// counts up to 12
+#define _TRACE_NARGS(...)	_TRACE_NTH(0, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _TRACE_NTH(z, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, n, ...)	n
+#define _TRACE(fmt, a0, a1, a2, a3, a4, a5, ...) \
+	trace_event(fmt, (unsigned int)(a0), (unsigned int)(a1), (unsigned int)(a2), \
+		(unsigned int)(a3), (unsigned int)(a4), (unsigned int)(a5))
@@ -1,12 +1,84 @@
+#include "uart.h"
+#include "vic.h"
+
 #define GPA0CON  	(*(volatile unsigned int *)0xE0200000) 
 
 #define ULCON0  	(*(volatile unsigned int *)0xE2900000) 
 #define UCON0  		(*(volatile unsigned int *)0xE2900004) 
+#define UFCON0  	(*(volatile unsigned int *)0xE2900008) 
 #define UTRSTAT0  	(*(volatile unsigned int *)0xE2900010)
+#define UFSTAT0  	(*(volatile unsigned int *)0xE2900018)
 #define UTXH0  		(*(volatile unsigned char *)0xE2900020) 
 #define URXH0  		(*(volatile unsigned char *)0xE2900024) 
 #define UBRDIV0 	(*(volatile unsigned int *)0xE2900028) 
 #define UDIVSLOT0  	(*(volatile unsigned int *)0xE290002C) 
+#define UINTP0  	(*(volatile unsigned int *)0xE2900030) 
+#define UINTM0  	(*(volatile unsigned int *)0xE2900038) 
+
+// UINTP / UINTM bits, UINTP is cleared by writing 1
+#define UINT_RXD	(1 << 0)
+#define UINT_ERROR	(1 << 1)
+#define UINT_TXD	(1 << 2)
+#define UINT_MODEM	(1 << 3)
+
+// UFSTAT: [7:0] Rx count, [8] Rx full, [23:16] Tx count, [24] Tx full
+#define UFSTAT_RX(s)	((s) & 0x1ff)
+#define UFSTAT_TX_FULL	(1 << 24)
+
+// sizes are powers of 2, the indices run free and wrap by mask
+#define TX_RING		4096
+#define RX_RING		256
+
+static char tx_ring[TX_RING];
+static char rx_ring[RX_RING];
+static volatile unsigned int tx_head, tx_tail;		// head moved by writers, tail by the irq
+static volatile unsigned int rx_head, rx_tail;		// head moved by the irq, tail by readers
+static volatile int uart_irq;				// rings serviced by the interrupt
+
+// with the FIFO off (before uart_init) there is only the holding register
+static int _tx_room(void)
+{
+	if (UFCON0 & 1)
+		return !(UFSTAT0 & UFSTAT_TX_FULL);
+	return UTRSTAT0 & (1<<1);
+}
+
+static int _rx_ready(void)
+{
+	if (UFCON0 & 1)
+		return UFSTAT_RX(UFSTAT0);
+	return UTRSTAT0 & (1<<0);
+}
+
+// tx ring -> Tx FIFO until either runs out, the Tx interrupt stays masked
+// while there is nothing to send
+static void _tx_fill(void)
+{
+	while (tx_tail != tx_head && _tx_room())
+	{
+		UTXH0 = tx_ring[tx_tail & (TX_RING - 1)];
+		tx_tail++;
+	}
+
+	if (tx_tail == tx_head)
+		UINTM0 |= UINT_TXD;
+}
+
+// Rx FIFO -> rx ring, bytes nobody made room for are dropped
+static void _rx_drain(void)
+{
+	char c;
+
+	while (_rx_ready())
+	{
+		c = URXH0;
+		if (rx_head - rx_tail < RX_RING)
+		{
+			rx_ring[rx_head & (RX_RING - 1)] = c;
+			rx_head++;
+		}
+	}
+}
 
 void uart_init(void)
 {
@@ -19,32 +91,158 @@ void uart_init(void)
 	// set UART SFRs
 	ULCON0 = 0x3;
 //	UCON0 = 0x245;		// Polling mode
-	UCON0 = 0x24A;		// DMA mode
+//	UCON0 = 0x24A;		// DMA mode
+	// interrupt mode: [1:0] Rx, [3:2] Tx 01, [6] Rx error, [7] Rx timeout,
+	// [9:8] level triggered Rx and Tx
+	UCON0 = 0x3C5;
+	// [0] FIFO on, [2:1] reset both, [6:4] Rx trigger 32 bytes, [10:8] Tx trigger 32 bytes
+	UFCON0 = 0x107;
 	UBRDIV0 = 0x23;
 	UDIVSLOT0 = 0x808;
+
+	// Tx is unmasked when there is something to send
+	UINTM0 = UINT_TXD | UINT_MODEM;
+	UINTP0 = 0xF;
+
+	// above the timer, below the audio DMA
+	irq_register(INT_UART0, uart_irq_handler, 0, 2);
+
+	uart_irq = 1;
+}
+
+// INT_UART0 = VIC1[10], registered with vic.c
+void uart_irq_handler(void * ctx)
+{
+	unsigned int pend = UINTP0;
+
+	if (pend & (UINT_RXD | UINT_ERROR))
+		_rx_drain();
+	if (pend & UINT_TXD)
+		_tx_fill();
+
+	UINTP0 = pend;
+}
+
+// what the interrupt does, by hand: for irq off, irq context and before uart_init
+void uart_poll(void)
+{
+	unsigned int flags = irq_save();
+
+	_rx_drain();
+	_tx_fill();
+	irq_restore(flags);
+}
+
+// after new bytes in the tx ring: start them, or send them now if nobody else will
+static void _tx_kick(void)
+{
+	_tx_fill();
+	if (uart_irq && tx_tail != tx_head)
+		UINTM0 &= ~UINT_TXD;
+	else
+		while (tx_tail != tx_head)
+			_tx_fill();
 }
 
 int uart_putchar(char c)
 {
-	// polling UTRSTAT0	
-	//while ((UTRSTAT0 & (1<<2)) == 0)
-	while (!(UTRSTAT0 & (1<<2)))
-		;
+	unsigned int flags;
 
-	UTXH0 = c;
+	// the ring is full: wait for the wire, the irq may be off
+	while (tx_head - tx_tail == TX_RING)
+		uart_poll();
+
+	flags = irq_save();
+	tx_ring[tx_head & (TX_RING - 1)] = c;
+	tx_head++;
+	_tx_kick();
+	irq_restore(flags);
 	
 	return 0;
 }
 
+// queues what fits in the tx ring and returns how much of buf that was,
+// never waits; '\n' goes out as "\r\n" like putchar() does
+int uart_write(const char * buf, int len)
+{
+	unsigned int flags;
+	int i;
+
+	flags = irq_save();
+	for (i = 0; i < len; i++)
+	{
+		if (TX_RING - (tx_head - tx_tail) < (buf[i] == '\n' ? 2 : 1))
+			break;
+		if (buf[i] == '\n')
+			tx_ring[tx_head++ & (TX_RING - 1)] = '\r';
+		tx_ring[tx_head++ & (TX_RING - 1)] = buf[i];
+	}
+	_tx_kick();
+	irq_restore(flags);
+
+	return i;
+}
+
+// up to len bytes of what has come in, never waits
+int uart_read(char * buf, int len)
+{
+	int i;
+
+	if (!uart_irq)
+		uart_poll();
+
+	for (i = 0; i < len && rx_tail != rx_head; i++)
+	{
+		buf[i] = rx_ring[rx_tail & (RX_RING - 1)];
+		rx_tail++;
+	}
+
+	return i;
+}
+
+// until the tx ring, the FIFO and the shift register are all empty
+void uart_flush(void)
+{
+	while (tx_tail != tx_head || !(UTRSTAT0 & (1<<2)))
+		uart_poll();
+}
+
+// for panic paths: irq off, whatever is queued goes first, then buf, all by
+// polling; works with the VIC or the rings in any state
+int uart_sync_write(const char * buf, int len)
+{
+	unsigned int flags = irq_save();
+	int i;
+
+	while (tx_tail != tx_head)
+		_tx_fill();
+
+	for (i = 0; i < len; i++)
+	{
+		if (buf[i] == '\n')
+		{
+			while (!_tx_room())
+				;
+			UTXH0 = '\r';
+		}
+		while (!_tx_room())
+			;
+		UTXH0 = buf[i];
+	}
+
+	while (!(UTRSTAT0 & (1<<2)))
+		;
+	irq_restore(flags);
+
+	return len;
+}
+
 char uart_getchar(void)
 {
 	char c;
-	// polling UTRSTAT0	
-	//while ((UTRSTAT0 & (1<<0)) == 0)
-	while (!(UTRSTAT0 & (1<<0)))
-		;
 
-	c = URXH0;
+	while (uart_read(&c, 1) == 0)
+		uart_poll();
 	
 	return c;
 }
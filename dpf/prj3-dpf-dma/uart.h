@@ -1,4 +1,20 @@
 
+// UART0, 115200 8N1: FIFOs on, Tx and Rx through ring buffers serviced by
+// the UART interrupt (VIC1[10]); until uart_init() everything is polled;
+// irq_init() first
 void uart_init(void);
+void uart_irq_handler(void * ctx);
 
-int uart_putchar(char c);char uart_getchar(void);
\ No newline at end of file
+int uart_putchar(char c);
+char uart_getchar(void);
+
+// never wait: what of buf got queued / how many bytes came in
+int uart_write(const char * buf, int len);
+int uart_read(char * buf, int len);
+
+// moves bytes between the FIFOs and the rings by hand, safe with irq off
+void uart_poll(void);
+// until everything queued is out on the wire
+void uart_flush(void);
+// polls everything out, for panic paths where interrupts can't be trusted
+int uart_sync_write(const char * buf, int len);
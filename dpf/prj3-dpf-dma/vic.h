@@ -0,0 +1,67 @@
+
+// S5PV210 VIC0 ~ VIC3, 32 sources each: interrupt n is VIC(n / 32) bit n % 32.
+// irq_init() points every vector at asm_IRQ_handler (irq.s), which calls
+// C_IRQ_handler() here; that runs the registered handlers of all pending
+// sources, highest priority (0) first.
+
+#define IRQ_NR		128
+#define IRQ_PRIOS	16		// 0 highest ~ 15, also written to VECTPRIORITY
+
+// the sources used so far
+#define INT_EINT16	16		// EINT16 ~ 31 share it, see EXT_INT_2_PEND
+#define INT_MDMA	18
+#define INT_PDMA0	19
+#define INT_TIMER0	21
+#define INT_TIMER1	22
+#define INT_UART0	42
+
+typedef void (*irq_handler_t)(void * ctx);
+
+// all sources off, no handlers
+void irq_init(void);
+
+// handler(ctx) for interrupt n at priority prio, and enables it; -1 if n
+// is out of range or already has a handler
+int irq_register(int n, irq_handler_t handler, void * ctx, int prio);
+void irq_unregister(int n);
+
+void irq_enable(int n);
+void irq_disable(int n);
+
+// 1: while a handler runs, sources of a higher priority (lower number)
+// may interrupt it; 0 (default): handlers run with irqs off
+extern int irq_nesting;
+
+// CCNT cycles: latency from entering C_IRQ_handler() to the handler
+// (behind higher priorities), and the handler's own run time
+struct irq_stat {
+	unsigned int count;
+	unsigned int max_latency;
+	unsigned int max_cycles;
+};
+
+const struct irq_stat * irq_get_stat(int n);
+void irq_clear_stats(void);
+
+// the interrupted pc of the irq being handled, 0 outside handlers
+unsigned int irq_pc(void);
+
+// frame: the interrupted registers asm_IRQ_handler saved, see irq.s
+void C_IRQ_handler(unsigned int * frame);
+
+// irq off, returns the cpsr to give back to irq_restore()
+static inline unsigned int irq_save(void)
+{
+	unsigned int cpsr;
+
+	__asm__ __volatile__(
+		"mrs %0, cpsr\n\t"
+		"cpsid i"
+		: "=r" (cpsr) : : "memory");
+	return cpsr;
+}
+
+static inline void irq_restore(unsigned int cpsr)
+{
+	__asm__ __volatile__("msr cpsr_c, %0" : : "r" (cpsr) : "memory");
+}
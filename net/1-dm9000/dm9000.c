@@ -1,4 +1,5 @@
 #include "stdio.h"
+#include "ticks.h"
 
 #define DM_ADDR_PORT (*((volatile unsigned short *) 0x88000000)) //地址口
 #define DM_DATA_PORT (*((volatile unsigned short *) 0x88000004)) //数据口
@@ -63,15 +64,9 @@
 #define DM9000_ISR             0xFE
 #define DM9000_IMR             0xFF
 
-void delay(int t)
-{
-	int i;
-
-	for (i = 0; i < t; i++)
-		;
-
-	return;
-}
+// bus turnaround between data port accesses, and how long a frame may take to go out
+#define DM_PORT_DELAY_US	1
+#define DM_TX_TIMEOUT_US	10000
 
 //写DM9000寄存器   
 void __inline dm_reg_write(unsigned char reg, unsigned char data)   
@@ -100,11 +95,11 @@ void dm_read_id(char id[])
 void dm_init(void)   
 {   
 	dm_reg_write(DM9000_NCR,1);         //软件复位DM9000   
-	delay(30);              //延时至少20μs   
+	udelay(20);             //延时至少20μs   
 	dm_reg_write(DM9000_NCR,0);         //清除复位位   
 
 	dm_reg_write(DM9000_NCR,1);         //为了确保复位正确，再次复位   
-	delay(30);   
+	udelay(20);   
 	dm_reg_write(DM9000_NCR,0);   
 
 	dm_reg_write(DM9000_GPCR,1);       //设置GPIO0为输出   
@@ -136,6 +131,7 @@ void dm_init(void)
 void dm_tran_packet(unsigned char *datas, int length)   
 {   
 	int i;   
+	unsigned long long t;
 
 	dm_reg_write(DM9000_IMR, 0x80);          //在发送数据过程中禁止网卡中断   
 
@@ -147,16 +143,17 @@ void dm_tran_packet(unsigned char *datas, int length)
 	//发送数据   
 	for(i=0;i<length;i+=2)   
 	{   
-		delay(50);   
+		udelay(DM_PORT_DELAY_US);   
 		DM_DATA_PORT = datas[i]|(datas[i+1]<<8);            //8位数据转换为16位数据输出   
 	}       
 
 	dm_reg_write(DM9000_TCR, 0x01);          //把数据发送到以太网上   
 
-	while((dm_reg_read(DM9000_NSR) & 0x0c) == 0)   
+	t = timeout_start(DM_TX_TIMEOUT_US);
+	while((dm_reg_read(DM9000_NSR) & 0x0c) == 0 && !timeout_expired(t))   
 		;                           //等待数据发送完成   
 
-	delay(50);   
+	udelay(DM_PORT_DELAY_US);   
 
 	dm_reg_write(DM9000_NSR, 0x2c);          //清除TX状态   
 	dm_reg_write(DM9000_IMR, 0x81);          //打开DM9000接收数据中断   
@@ -189,7 +186,7 @@ int dm_rec_packet(unsigned char *datas)
 			{   
 				for(i=0; i<rx_length; i+=2)          //16位数据转换为8位数据存储   
 				{   
-					delay(50);   
+					udelay(DM_PORT_DELAY_US);   
 					temp = DM_DATA_PORT;   
 					datas[i] = temp & 0x0ff;   
 					datas[i + 1] = (temp >> 8) & 0x0ff;   
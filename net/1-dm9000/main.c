@@ -1,6 +1,7 @@
 #include "led.h"
 #include "uart.h"
 #include "stdio.h"
+#include "ticks.h"
 
 void handler(void)
 {
@@ -45,7 +46,7 @@ int mymain(void)
 
 	dm_read_id(buf);
 	printf("DM9000 id is %x %x %x %x \n", buf[0], buf[1], buf[2], buf[3]);
-	delay(5000000);
+	mdelay(1000);
 
 	while (1)
 	{
@@ -54,7 +55,7 @@ int mymain(void)
 
 		printf("recv arp ...\n");
 		dm_recv_arp();
-		delay(1000000);
+		mdelay(1000);
 	}
 
 	return 0;
@@ -0,0 +1,20 @@
+
+// monotonic time base: PWM timer 4 free-running at 1MHz (PCLK_PSYS 66MHz
+// / 66), a 32-bit count widened to 64 bits in software. Timer 4 has no
+// pin and its interrupt stays off, so it is free for this; the first
+// get_ticks() starts it, ticks_init() restarts it at 0.
+
+#define TICKS_PER_US	1
+
+void ticks_init(void);
+
+// microseconds since ticks_init(); must be called at least once every
+// 71 minutes (one 32-bit wrap) to stay monotonic, every delay does
+unsigned long long get_ticks(void);
+
+void udelay(unsigned int us);
+void mdelay(unsigned int ms);
+
+// t = timeout_start(us); while (!ready) if (timeout_expired(t)) break;
+unsigned long long timeout_start(unsigned int us);
+int timeout_expired(unsigned long long deadline);